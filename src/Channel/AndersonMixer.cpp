@@ -0,0 +1,152 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+// Headers
+#include "AndersonMixer.h"
+
+
+// Constants
+const double AndersonMixer::RESTART_GROWTH = 100.0;
+
+
+// Constructor / Destructor
+AndersonMixer::AndersonMixer( int depth, int first, int last )
+{
+    this->depth = depth;
+    this->first = first;
+    this->last = last;
+
+    const int length = last - first + 1;
+
+    this->f_prev.resize( length );
+    this->g_prev.resize( length );
+
+    this->df.assign( depth, std::vector<double>( length ) );
+    this->dg.assign( depth, std::vector<double>( length ) );
+
+    this->a.resize( depth * depth );
+    this->gamma.resize( depth );
+
+    reset();
+}
+
+
+// Public Methods
+void AndersonMixer::reset()
+{
+    this->count = 0;
+    this->next = 0;
+    this->has_prev = false;
+    this->best_residual = -1;
+}
+
+void AndersonMixer::mix( const ScalarField &u, ScalarField *g, double residual )
+{
+    const int length = last - first + 1;
+
+    if ( best_residual >= 0 && residual > RESTART_GROWTH * best_residual )
+        reset();
+
+    if ( best_residual < 0 || residual < best_residual )
+        best_residual = residual;
+
+    // Store the differences with the previous iteration.
+    if ( has_prev )
+    {
+        std::vector<double> &df_k = df[next];
+        std::vector<double> &dg_k = dg[next];
+
+        for ( int i = 0; i < length; i++ )
+        {
+            const double g_i = (*g)(first + i);
+            const double f_i = g_i - u(first + i);
+
+            df_k[i] = f_i - f_prev[i];
+            dg_k[i] = g_i - g_prev[i];
+        }
+
+        next = (next + 1) % depth;
+        count = min( count + 1, depth );
+    }
+
+    for ( int i = 0; i < length; i++ )
+    {
+        g_prev[i] = (*g)(first + i);
+        f_prev[i] = g_prev[i] - u(first + i);
+    }
+    has_prev = true;
+
+    if ( count == 0 )
+        return;
+
+    // Least squares min |f - DF gamma| through the normal equations, which are
+    // small (depth x depth). A little regularization keeps them solvable when
+    // the differences become (nearly) dependent.
+    const int m = count;
+
+    double trace = 0;
+
+    for ( int j = 0; j < m; j++ )
+    {
+        for ( int k = 0; k <= j; k++ )
+        {
+            double dot = 0;
+            for ( int i = 0; i < length; i++ )
+                dot += df[j][i] * df[k][i];
+
+            a[j * m + k] = a[k * m + j] = dot;
+        }
+
+        double dot = 0;
+        for ( int i = 0; i < length; i++ )
+            dot += df[j][i] * f_prev[i];
+
+        gamma[j] = dot;
+        trace += a[j * m + j];
+    }
+
+    if ( trace == 0 )
+        return;
+
+    for ( int j = 0; j < m; j++ )
+        a[j * m + j] += 1E-12 * trace;
+
+    // Gaussian elimination (the matrix is symmetric positive definite, no pivoting).
+    for ( int j = 0; j < m; j++ )
+    {
+        for ( int k = j + 1; k < m; k++ )
+        {
+            const double factor = a[k * m + j] / a[j * m + j];
+
+            for ( int l = j; l < m; l++ )
+                a[k * m + l] -= factor * a[j * m + l];
+
+            gamma[k] -= factor * gamma[j];
+        }
+    }
+
+    for ( int j = m - 1; j >= 0; j-- )
+    {
+        for ( int l = j + 1; l < m; l++ )
+            gamma[j] -= a[j * m + l] * gamma[l];
+
+        gamma[j] /= a[j * m + j];
+    }
+
+    // The next iterate: G(u) - DG gamma.
+    for ( int j = 0; j < m; j++ )
+        for ( int i = 0; i < length; i++ )
+            (*g)(first + i) -= gamma[j] * dg[j][i];
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+// Headers
+#include "Typedefs.h"
+
+#include <vector>
+
+
+/**
+ * Anderson acceleration of a fixed point iteration u = G(u).
+ * Keeps the last few iterates and images of G, and replaces the next iterate by
+ * the combination of them with the smallest residual G(u) - u. For the relaxed
+ * loops in CPModel it turns the linear convergence into that of a Krylov method,
+ * without tuning the relaxation.
+ */
+class AndersonMixer
+{
+private:
+    static const double RESTART_GROWTH;  /// Growth of the residual that restarts the history.
+
+    int depth;   /// Number of differences kept (history depth).
+    int first;   /// First index of the unknowns.
+    int last;    /// Last index of the unknowns.
+
+    int count;   /// Number of differences in the history.
+    int next;    /// Slot of the next difference (circular).
+    bool has_prev;
+
+    double best_residual;  /// Smallest residual norm since the last reset (-1 if none).
+
+    std::vector<double> f_prev;  /// Previous residual G(u) - u.
+    std::vector<double> g_prev;  /// Previous image G(u).
+
+    std::vector< std::vector<double> > df;  /// Differences of successive residuals.
+    std::vector< std::vector<double> > dg;  /// Differences of successive images.
+
+    std::vector<double> a;      /// Normal equations of the least squares (count x count).
+    std::vector<double> gamma;  /// Their solution.
+
+public:
+    /**
+     * Constructor.
+     * @param depth  History depth.
+     * @param first  First index of the unknowns in the ScalarFields.
+     * @param last   Last index of the unknowns in the ScalarFields.
+     */
+    AndersonMixer( int depth, int first, int last );
+
+    /**
+     * Forget the history (call when a new fixed point problem starts).
+     */
+    void reset();
+
+    /**
+     * Accelerates one iteration. When the residual grows past RESTART_GROWTH times the
+     * smallest one since the last reset, the history no longer describes G near u, and
+     * it is dropped.
+     * @param u         The current iterate.
+     * @param g         The image G(u), replaced by the next iterate.
+     * @param residual  Norm of the residual of u.
+     */
+    void mix( const ScalarField &u, ScalarField *g, double residual );
+};
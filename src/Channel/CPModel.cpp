@@ -16,10 +16,21 @@
 // Headers
 #include "CPModel.h"
 
+#include "AndersonMixer.h"
+#include "Grid.h"
+
+#include <algorithm>
+
 
 // Constants
 const double CPModel::lambda = 0.09;
 const double CPModel::kappa = 0.41;
+const double CPModel::WALL_Y_MIN = 1E-2;
+const double CPModel::WALL_Y_MAX = 1E6;
+const double CPModel::MIN_NEWTON_STEP = 1.0 / 16;
+const double CPModel::SMOOTH_WEIGHT = 2.0 / 3;
+const double CPModel::CORRECTION_WEIGHT = 0.8;
+const double CPModel::COARSEST_REDUCTION = 1E-3;
 
 
 // Constructor / Destructor
@@ -37,6 +48,7 @@ CPModel::CPModel( const ScrubberParam &param )
 
     // FIXME: Casts to enums from integer (thanks to parameter parser sucking).
     this->loop_model = (LoopModel) param.channel.loop_model;
+    this->solver = (ProfileSolver) param.channel.solver;
     this->errork = param.errork;
     this->relax = param.relax;
 
@@ -44,156 +56,828 @@ CPModel::CPModel( const ScrubberParam &param )
     this->globbv = param.channel.globbv;
     this->wallbc = (WallBC) param.channel.wallbc;
     this->wallbv = param.channel.wallbv;
+    this->wall_function = param.channel.wall_function;
+
+    if ( wall_function )
+        fillWallLaw();
+
+    this->pg = 0;
+
+    this->mu_wall = 0;
+    this->mu_wall_top = 0;
+
+    // Allocate the y vector and fill it with values. On a uniform grid the face
+    // coefficients are exactly 1 and the volumes dy^2, as without the grid.
+    this->grid = new Grid( param.channel.radius, n, param.channel.stretch );
+
+    y_mu.resize( n+1 );
+    gap.resize( n+1 );
+    face_coef.resize( n+1 );
+    cell_vol.resize( n+1 );
+
+    for (int i = 0; i < n+1; i++)
+    {
+        y_mu(i) = grid->faceAt( i );
+        gap(i) = grid->gapAt( i );
+        face_coef(i) = dy / gap(i);
+        cell_vol(i) = grid->widthAt( i ) * dy;
+    }
+
+    // With the wall function the first nodes lie in the log layer, where the difference
+    // of the velocities around a face is the derivative at the logarithmic mean of their
+    // wall distances (rather than at the face), so the mixing length is taken there.
+    if ( wall_function )
+    {
+        for ( int i = 1; i < n; i++ )
+        {
+            const double y_b = grid->nodeAt( i );
+            const double y_t = grid->nodeAt( i+1 );
+
+            if ( y_t <= delta )
+                y_mu(i) = (y_t - y_b) / log( y_t / y_b );
+            else if ( y_b >= delta )
+                y_mu(i) = diameter - (y_t - y_b) / log( (diameter - y_b) / (diameter - y_t) );
+        }
+    }
+
+    this->iterations = 0;
+    this->outer_iterations = 0;
+
+    // Scratch arrays of the solvers, so nothing is allocated per iteration.
+    work.resize( n+2 );
+    newton_step.resize( n+2 );
+    mu_eff.resize( n+1 );
+    lower.resize( n+1 );
+    diag.resize( n+1 );
+    upper.resize( n+1 );
+    c_prime.resize( n+1 );
+    tangent.resize( n+1 );
+    res.resize( n+1 );
+
+    mg_u.resize( n+2 );
+    mg_e.resize( n+2 );
+    mg_p.resize( n+2 );
+    mg_f.resize( n+1 );
+    mg_d.resize( n+1 );
+    mg_r.resize( n+1 );
+
+    // Only the volumes inside the pipe are unknowns, the ghost points follow from them.
+    this->anderson = NULL;
+    if ( param.anderson > 0 )
+        this->anderson = new AndersonMixer( param.anderson, 1, n );
+
+    // The coarser grids of the Jacobi loops (the direct solvers don't need them) have
+    // half the volumes, two volumes make one, down to MIN_COARSE_N. The faces of a
+    // stretched grid are those of the finer grid too.
+    this->coarse = NULL;
+    if ( param.levels > 1 && solver == SOLVER_JACOBI && n % 2 == 0 && n / 2 >= MIN_COARSE_N )
+    {
+        ScrubberParam coarse_param = param;
+        coarse_param.channel.n = n / 2;
+        coarse_param.channel.dx = param.channel.radius*2 / coarse_param.channel.n;
+        coarse_param.levels = param.levels - 1;
+
+        this->coarse = new CPModel( coarse_param );
+    }
 }
 
-CPModel::~CPModel() {}
+CPModel::~CPModel()
+{
+    delete anderson;
+    delete coarse;
+    delete grid;
+}
 
 
 // Private methods
-ScalarField CPModel::velocityProfile( ScalarField u )
+void CPModel::velocityProfile( ScalarField *u )
 {
+    if ( coarse != NULL )
+    {
+        loopMultigrid( u );
+        return;
+    }
+
+    // The direct solvers handle all loop models through viscosityAt().
+    if ( solver == SOLVER_THOMAS )
+    {
+        loopThomas( u );
+        return;
+    }
+    if ( solver == SOLVER_NEWTON )
+    {
+        loopNewton( u );
+        return;
+    }
+
     // FIXME: Check for invalid loop_model shouldn't be done here, but when parsing commandline arguments.
     // Calculate the velocity profile based on various loop models.
     switch ( loop_model ) {
         case LM_SIMPLE:
-            u = loopSimple( u );
+            loopSimple( u );
             break;
         case LM_PRANDTL:
-            u = loopPrandtl( u );
-            break;
         case LM_VAN_DRIEST:
-            u = loopVanDriest( u );
+            loopMixingLength( u );
             break;
         default:
             printf( "Unkown loop_model [%d], stopping...\n", loop_model );
             break;
     }
-    return u;
 }
 
-ScalarField CPModel::loopSimple( ScalarField u )
+void CPModel::loopSimple( ScalarField *u )
 {
-    ScalarField unew( u.shape() );
-    unew = 0;
+    // Readability, the references follow the swaps of the buffers.
+    const ScalarField &_u = *u;
+    ScalarField &unew = work;
 
     double error = 10000;
+    double sum = 0;
+    double defect_sum = 0;
 
-    // Loop while the error is too big.
+    if ( anderson != NULL )
+        anderson->reset();
+
+    // Loop while the error is too big. One parallel region for all sweeps.
+#pragma omp parallel
     while ( error > errork )
     {
-        // Walk over all volumes
-#pragma omp parallel for
+        // Walk over all volumes, summing the change and the defect for the error on the way.
+#pragma omp for reduction(+:sum,defect_sum)
         for ( int i = 1; i <= n; i++ )
-            unew(i) = (-pg * pow2( dy ) + mu * u(i+1) + mu * u(i-1) )/(2*mu);
+        {
+            const double mu_b = mu * face_coef(i-1);
+            const double mu_t = mu * face_coef(i);
+
+            unew(i) = (-pg * cell_vol(i) + mu_t * _u(i+1) + mu_b * _u(i-1) )/(mu_t + mu_b);
+            sum += froTerm( unew(i), _u(i) );
+            defect_sum += defectTerm( _u, i, mu_b, mu_t );
+        }
+
+#pragma omp single
+        {
+            iterations++;
+            finishSweep( u, &sum, &defect_sum, &error );
+        }
+    }
+}
+
+void CPModel::loopMixingLength( ScalarField *u )
+{
+    // Readability, the references follow the swaps of the buffers.
+    const ScalarField &_u = *u;
+    ScalarField &unew = work;
+
+    double error = 10000;
+    double sum = 0;
+    double defect_sum = 0;
+
+    if ( anderson != NULL )
+        anderson->reset();
+
+    // Loop while the error is too big. One parallel region for all sweeps.
+#pragma omp parallel
+    while ( error > errork )
+    {
+#pragma omp for reduction(+:sum,defect_sum)
+        for ( int i = 1; i <= n ; i++ )
+        {
+            // Readability. The viscosity at the top and bottom points.
+            const double mu_b = conductanceAt( _u, i-1 );
+            const double mu_t = conductanceAt( _u, i );
+
+            unew(i) = (-pg * cell_vol(i) + mu_t * _u(i+1) + mu_b * _u(i-1)) /
+                      (mu_t + mu_b) *
+                      (1-relax) + _u(i) * relax;
+            sum += froTerm( unew(i), _u(i) );
+            defect_sum += defectTerm( _u, i, mu_b, mu_t );
+        }
+
+#pragma omp single
+        {
+            iterations++;
+            finishSweep( u, &sum, &defect_sum, &error );
+        }
+    }
+}
+
+void CPModel::loopThomas( ScalarField *u )
+{
+    double error = 10000;
 
-        // Set the ghost point
-        setGhost( &unew );
+    // Loop while the error is too big.
+    while ( error > errork )
+    {
+        iterations++;
+
+        picardStep( *u, &work );
+
+        // The constant viscosity doesn't depend on u, one solve is exact.
+        if ( loop_model == LM_SIMPLE )
+        {
+            swapFields( u, &work );
+            break;
+        }
 
         // Get the new error
-        error = froNorm( unew, u );
+        error = froNorm( work, *u );
 
-        u = unew;
+        // The new profile becomes u
+        swapFields( u, &work );
     }
-    return u;
 }
 
-ScalarField CPModel::loopPrandtl( ScalarField u )
+void CPModel::loopNewton( ScalarField *u )
 {
-    ScalarField unew( u.shape() );
-    unew = 0;
+    // Readability, the references follow the swaps of the buffers.
+    const ScalarField &_u = *u;
+    ScalarField &unew = work;
+
+    setGhost( u );
+    double res_norm = residual( _u, &res );
 
     double error = 10000;
 
     // Loop while the error is too big.
     while ( error > errork )
     {
+        iterations++;
+
+        // Jacobian of the residual: the flux mu_eff(k) (u(k+1) - u(k)) changes with
+        // tangent(k) per unit of u(k+1) - u(k). A ghost point moves opposite to its
+        // neighbour, which doubles the change of the wall flux.
 #pragma omp parallel for
-        for ( int i = 1; i <= n ; i++ )
+        for ( int i = 0; i <= n; i++ )
+            conductanceAt( _u, i, &tangent(i) );
+
+        for ( int i = 1; i <= n; i++ )
         {
-            // Readability. Calculate the prandtl mixing length and subsequently the
-            // viscosity at the top and bottom points.
-            const double l_b = prandtlLength( y_mu(i-1) );
-            const double l_t = prandtlLength( y_mu(i) );
+            lower(i) = tangent(i-1);
+            diag(i) = -tangent(i-1) - tangent(i);
+            upper(i) = tangent(i);
+            newton_step(i) = -res(i);
+        }
 
-            const double mu_b = mu + pow2( l_b ) * rho * abs( dudy( u, i-1 ) );
-            const double mu_t = mu + pow2( l_t ) * rho * abs( dudy( u, i ) );
+        diag(1) -= tangent(0);
+        diag(n) -= tangent(n);
 
-            unew(i) = (-pg * pow2( dy ) + mu_t * u(i+1) + mu_b * u(i-1)) /
-                      (mu_t + mu_b) *
-                      (1-relax) + u(i) * relax;
+        solveTridiagonal( lower, diag, upper, &newton_step );
+
+        // Line search: halve the Newton step until the residual decreases.
+        double step = 1.0;
+        double new_norm = res_norm;
+
+        for ( ; step >= MIN_NEWTON_STEP; step *= 0.5 )
+        {
+            for ( int i = 1; i <= n; i++ )
+                unew(i) = _u(i) + step * newton_step(i);
+
+            setGhost( &unew );
+            new_norm = residual( unew, &res );
+
+            if ( new_norm < (1 - 1E-4 * step) * res_norm )
+                break;
         }
 
-        // Set the ghost point
-        setGhost( &unew );
+        // Far from the solution (e.g. starting from the laminar profile) the Newton
+        // steps are cut very short; a Picard step gets closer much faster.
+        if ( step < MIN_NEWTON_STEP )
+        {
+            picardStep( _u, &unew );
+            new_norm = residual( unew, &res );
+        }
 
-       // Get the new error
-        error = froNorm( unew, u );
+        // Get the new error
+        error = froNorm( unew, _u );
 
-        // Write the new values to u
-        u = unew;
+        // The new profile becomes u
+        swapFields( u, &work );
+        res_norm = new_norm;
     }
-    return u;
 }
 
-ScalarField CPModel::loopVanDriest( ScalarField u )
+void CPModel::loopMultigrid( ScalarField *u )
 {
-    ScalarField unew( u.shape() );
-    unew = 0;
+    // The equations are solved for a source f, which is pg on this grid.
+    mg_f = pg;
 
-    double error = 10000;
+    const double f_norm = abs( pg ) * sqrt( (double) n );
 
-    // Loop while the error is too big.
+    setGhost( u );
+    double error = defect( *u, mg_f, &mg_d ) / f_norm;
+
+    // Loop while the residual is too big.
     while ( error > errork )
+    {
+        iterations++;
+
+        vCycle( u, mg_f );
+
+        error = defect( *u, mg_f, &mg_d ) / f_norm;
+    }
+}
+
+void CPModel::vCycle( ScalarField *u, const ScalarField &f )
+{
+    // The coarsest grid is solved directly, with the Picard iterations of loopThomas.
+    if ( coarse == NULL )
+    {
+        const double d_start = defect( *u, f, &mg_d );
+
+        for ( int k = 0; k < MAX_COARSEST_ITERATIONS && defect( *u, f, &mg_d ) > COARSEST_REDUCTION * d_start; k++ )
+        {
+            picardStep( *u, &work, &f );
+            swapFields( u, &work );
+        }
+        return;
+    }
+
+    smooth( u, f, SMOOTH_SWEEPS );
+
+    defect( *u, f, &mg_d );
+
+    // Restrict the profile and the defect: a coarse volume is two fine ones, weighted
+    // by their width. The coarse arrays are those of the coarse model.
+    const int coarse_n = coarse->n;
+    const Grid &cg = *coarse->grid;
+
+    ScalarField &u_coarse = coarse->mg_u;
+    ScalarField &f_coarse = coarse->mg_f;
+    ScalarField &d_coarse = coarse->mg_d;
+    ScalarField &d_restricted = coarse->mg_r;
+
+    for ( int i = 1; i <= coarse_n; i++ )
+    {
+        const double w_b = grid->widthAt( 2*i-1 );
+        const double w_t = grid->widthAt( 2*i );
+
+        u_coarse(i) = (w_b * (*u)(2*i-1) + w_t * (*u)(2*i)) / (w_b + w_t);
+        d_restricted(i) = (w_b * mg_d(2*i-1) + w_t * mg_d(2*i)) / (w_b + w_t);
+    }
+    coarse->setGhost( &u_coarse );
+
+    // From the wall to the first coarse node the flux passes the first fine node, so the
+    // wall face gets the harmonic mean viscosity of the two fine faces on the way. Near
+    // turbulent walls the viscous layer isn't resolved, and the coarse grid on its own
+    // would find a much lower wall resistance, which makes its corrections overshoot.
+    const double y_c = cg.nodeAt( 1 );
+    const double y_f = grid->nodeAt( 1 );
+
+    coarse->mu_wall = y_c / (y_f / viscosityAt( *u, 0 ) + (y_c - y_f) / viscosityAt( *u, 1 ));
+    coarse->mu_wall_top = y_c / (y_f / viscosityAt( *u, n ) + (y_c - y_f) / viscosityAt( *u, n-1 ));
+
+    // Full approximation scheme: the coarse source is the coarse operator of the
+    // restricted profile, plus the restricted defect of this grid.
+    f_coarse = 0;
+    coarse->defect( u_coarse, f_coarse, &d_coarse );
+
+    for ( int i = 1; i <= coarse_n; i++ )
+        f_coarse(i) = -d_coarse(i) + d_restricted(i);
+
+    ScalarField &correction = coarse->mg_e;
+    correction = u_coarse;
+
+    coarse->vCycle( &u_coarse, f_coarse );
+
+    // Prolongate the correction (not the coarse profile, which lacks the details).
+    for ( int i = 0; i <= coarse_n+1; i++ )
+        correction(i) = u_coarse(i) - correction(i);
+
+    grid->interpolate( cg, correction, &mg_p );
+
+    // Slightly damped, the full correction can end up alternating around the solution
+    // (the viscosity has a kink where du/dy changes sign).
+    for ( int i = 1; i <= n; i++ )
+        (*u)(i) += CORRECTION_WEIGHT * mg_p(i);
+    setGhost( u );
+
+    smooth( u, f, SMOOTH_SWEEPS );
+}
+
+void CPModel::smooth( ScalarField *u, const ScalarField &f, int sweeps )
+{
+    // Readability, the reference follows the swaps of the buffers.
+    const ScalarField &_u = *u;
+
+    for ( int k = 0; k < sweeps; k++ )
     {
 #pragma omp parallel for
-        for ( int i = 1; i <= n ; i++ )
+        for ( int i = 0; i <= n; i++ )
+            conductanceAt( _u, i, &tangent(i) );
+
+        defect( _u, f, &mg_d );
+
+        // The diagonal of the Jacobian is larger than that of the frozen viscosity
+        // (mu_t grows with |du/dy|), which keeps the sweeps from overshooting.
+        for ( int i = 1; i <= n; i++ )
+            work(i) = _u(i) - SMOOTH_WEIGHT * mg_d(i) * cell_vol(i) / (tangent(i-1) + tangent(i));
+
+        setGhost( &work );
+
+        swapFields( u, &work );
+    }
+}
+
+double CPModel::defect( const ScalarField &u, const ScalarField &f, ScalarField *d )
+{
+    double sum = 0;
+
+#pragma omp parallel for reduction(+:sum)
+    for ( int i = 1; i <= n; i++ )
+    {
+        const double flux_b = conductanceAt( u, i-1 ) * (u(i) - u(i-1));
+        const double flux_t = conductanceAt( u, i ) * (u(i+1) - u(i));
+
+        (*d)(i) = f(i) - (flux_t - flux_b) / cell_vol(i);
+        sum += pow2( (*d)(i) );
+    }
+
+    return sqrt( sum );
+}
+
+void CPModel::picardStep( const ScalarField &u, ScalarField *unew, const ScalarField *f )
+{
+    const double ghost = ghostSum();
+
+    // Freeze the viscosity
+#pragma omp parallel for
+    for ( int i = 0; i <= n; i++ )
+        mu_eff(i) = conductanceAt( u, i );
+
+    // Row i: -mu_b u(i-1) + (mu_b + mu_t) u(i) - mu_t u(i+1) = -pg dy^2 (cell_vol on a
+    // stretched grid). The ghost points follow from u(ghost) = ghost - u(neighbour),
+    // which moves them into the first and last row.
+    for ( int i = 1; i <= n; i++ )
+    {
+        lower(i) = -mu_eff(i-1);
+        diag(i) = mu_eff(i-1) + mu_eff(i);
+        upper(i) = -mu_eff(i);
+        (*unew)(i) = -( f != NULL ? (*f)(i) : pg ) * cell_vol(i);
+    }
+
+    diag(1) += mu_eff(0);
+    (*unew)(1) += mu_eff(0) * ghost;
+    diag(n) += mu_eff(n);
+    (*unew)(n) += mu_eff(n) * ghost;
+
+    solveTridiagonal( lower, diag, upper, unew );
+
+    // The mixing length viscosity grows with |du/dy|, so the plain iteration
+    // alternates between too steep and too flat profiles. Averaging with the old
+    // profile turns it into Heron's square root iteration for du/dy, which
+    // converges quadratically.
+    if ( loop_model != LM_SIMPLE )
+        for ( int i = 1; i <= n; i++ )
+            (*unew)(i) = 0.5 * ((*unew)(i) + u(i));
+
+    // Set the ghost point
+    setGhost( unew );
+}
+
+double CPModel::residual( const ScalarField &u, ScalarField *res )
+{
+    double sum = 0;
+
+#pragma omp parallel for reduction(+:sum)
+    for ( int i = 1; i <= n; i++ )
+    {
+        const double flux_b = conductanceAt( u, i-1 ) * (u(i) - u(i-1));
+        const double flux_t = conductanceAt( u, i ) * (u(i+1) - u(i));
+
+        (*res)(i) = flux_t - flux_b - pg * cell_vol(i);
+        sum += pow2( (*res)(i) );
+    }
+
+    return sqrt( sum );
+}
+
+void CPModel::solveTridiagonal( const ScalarField &lower, const ScalarField &diag,
+                                const ScalarField &upper, ScalarField *x )
+{
+    // Forward sweep, c_prime holds the modified upper diagonal.
+    ScalarField &d_prime = *x;
+
+    c_prime(1) = upper(1) / diag(1);
+    d_prime(1) = d_prime(1) / diag(1);
+
+    for ( int i = 2; i <= n; i++ )
+    {
+        const double denom = diag(i) - lower(i) * c_prime(i-1);
+
+        c_prime(i) = upper(i) / denom;
+        d_prime(i) = (d_prime(i) - lower(i) * d_prime(i-1)) / denom;
+    }
+
+    // Back substitution
+    for ( int i = n-1; i >= 1; i-- )
+        d_prime(i) -= c_prime(i) * d_prime(i+1);
+}
+
+double CPModel::viscosityAt( const ScalarField &u, int i, double *tangent )
+{
+    // The wall faces of a coarse grid, as set by the finer grid.
+    if ( mu_wall > 0 && ( i == 0 || i == n ) )
+    {
+        const double mu_w = ( i == 0 ) ? mu_wall : mu_wall_top;
+
+        if ( tangent != NULL )
+            *tangent = mu_w;
+        return mu_w;
+    }
+
+    const double g = abs( dudy( u, i ) );
+
+    // Wall function: the wall shear of the log law at the first node, as a viscosity.
+    // The ghost point mirrors the first node, so g * y_p is its velocity.
+    if ( wall_function && ( i == 0 || i == n ) && g > 0 )
+    {
+        const double y_p = 0.5 * gap(i);
+
+        double du_tau;
+        const double u_tau = frictionVelocity( g * y_p, y_p, &du_tau );
+
+        if ( tangent != NULL )
+            *tangent = 2 * rho * u_tau * du_tau * y_p;
+
+        return rho * pow2( u_tau ) / g;
+    }
+
+    double mu_t = 0;     // Turbulent viscosity
+    double dmu_t = 0;    // g * d(mu_t)/dg
+
+    switch ( loop_model ) {
+        case LM_PRANDTL:
         {
-            // Readability. Calculate the prandtl mixing length and subsequently the
-            // viscosity at the top and bottom points.
-            const double l_b = prandtlLength( y_mu(i-1) );
-            const double l_t = prandtlLength( y_mu(i) );
+            const double l = prandtlLength( y_mu(i) );
 
-            const double y_a_b = y_mu(i-1) * abs( l_b ) * abs( dudy( u, i-1 ) ) / (25 * nu);
-            const double y_a_t = y_mu(i) * abs( l_t ) * abs( dudy( u, i ) ) / (25 * nu);
+            mu_t = pow2( l ) * rho * g;
+            dmu_t = mu_t;
+            break;
+        }
+        case LM_VAN_DRIEST:
+        {
+            // Prandtl mixing length, damped near the nearest wall.
+            const double l = prandtlLength( y_mu(i) );
+            const double y_wall = std::min( y_mu(i), diameter - y_mu(i) );
 
-            const double l_b_vd = l_b * (1 - exp( -y_a_b ) );
-            const double l_t_vd = l_t * (1 - exp( -y_a_t ) );
+            const double y_a = y_wall * abs( l ) * g / (25 * nu);
 
-            const double mu_b = mu + pow2( l_b_vd ) * rho * abs( dudy( u, i-1 ) );
-            const double mu_t = mu + pow2( l_t_vd ) * rho * abs( dudy( u, i ) );
+            const double l_vd = l * (1 - exp( -y_a ) );
 
-            unew(i) = (-pg * pow2( dy ) + mu_t * u(i+1) + mu_b * u(i-1)) /
-                      (mu_t + mu_b) *
-                      (1-relax) + u(i) * relax;
+            mu_t = pow2( l_vd ) * rho * g;
+            dmu_t = mu_t + 2 * l_vd * l * exp( -y_a ) * y_a * rho * g;
+            break;
         }
+        default:
+            break;
+    }
+
+    if ( tangent != NULL )
+        *tangent = mu + mu_t + dmu_t;
+
+    return mu + mu_t;
+}
+
+void CPModel::fillWallLaw()
+{
+    wall_u_plus.resize( WALL_TABLE_SIZE );
+    wall_g_plus.resize( WALL_TABLE_SIZE );
+
+    wall_step = log( WALL_Y_MAX / WALL_Y_MIN ) / (WALL_TABLE_SIZE - 1);
+
+    double y_prev = 0;
+
+    for ( int k = 0; k < WALL_TABLE_SIZE; k++ )
+    {
+        const double y_plus = WALL_Y_MIN * exp( k * wall_step );
+
+        // In wall units the mixing length is kappa y+ (the outer limit lies far out),
+        // and (1 + l+^2 g+) g+ = 1 grows with g+, so bisect for g+ in [0, 1].
+        double lo = 0;
+        double hi = 1;
+
+        for ( int j = 0; j < 60; j++ )
+        {
+            const double g = 0.5 * (lo + hi);
+
+            double l = kappa * y_plus;
+
+            if ( loop_model == LM_VAN_DRIEST )
+                l *= 1 - exp( -y_plus * l * g / 25 );
+            else if ( loop_model == LM_SIMPLE )
+                l = 0;
+
+            if ( (1 + pow2( l ) * g) * g > 1 )
+                hi = g;
+            else
+                lo = g;
+        }
+
+        wall_g_plus(k) = 0.5 * (lo + hi);
+
+        // Trapezoidal rule, below WALL_Y_MIN the flow is laminar (g+ = 1).
+        if ( k == 0 )
+            wall_u_plus(k) = y_plus;
+        else
+            wall_u_plus(k) = wall_u_plus(k-1) + 0.5 * (wall_g_plus(k-1) + wall_g_plus(k)) * (y_plus - y_prev);
 
-        // Set the ghost point
-        setGhost( &unew );
+        y_prev = y_plus;
+    }
+}
+
+double CPModel::ghostSum()
+{
+    switch ( wallbc )
+    {
+        case WBC_VEL_GRADIENT:
+            return wallbv * gap(0);
+        default:
+            return 2 * wallbv;
+    }
+}
 
-       // Get the new error
-        error = froNorm( unew, u );
+double CPModel::bulkError( double log_pg, ScalarField *u )
+{
+    outer_iterations++;
+
+    // The pressure gradient drives the flow in the direction of globbv.
+    const double new_pg = ( globbv > 0 ) ? -exp( log_pg ) : exp( log_pg );
 
-        // Write the new values to u
-        u = unew;
+    // Warm start from the profile of the previous guess, scaled as turbulent flow.
+    if ( outer_iterations > 1 )
+    {
+        *u *= sqrt( new_pg / pg );
+        setGhost( u );
     }
-    return u;
+
+    this->pg = new_pg;
+    velocityProfile( u );
+
+    const double bulk_vel = grid->mean( *u );
+
+    return log( bulk_vel / globbv );
+}
+
+void CPModel::solvePressureGradient( ScalarField *u, double pg_guess )
+{
+    // The bulk velocity follows a power of pg: 1 for laminar flow, 1/2 for fully
+    // turbulent flow. On log scales that is nearly a straight line, so the root is
+    // found there. Start as the proportional scaling (slope 1), which never steps
+    // over the root, and then extrapolate with the secant until it is bracketed.
+    double a = ( pg_guess != 0 ) ? log( abs( pg_guess ) ) : log( abs( globbv ) / 400.0 );
+    double fa = bulkError( a,  u );
+
+    // A warm start may already be close enough.
+    if ( abs( fa ) <= errork )
+        return;
+
+    double b = a - fa;
+    double fb = bulkError( b,  u );
+
+    for ( int k = 0; fa * fb > 0; k++ )
+    {
+        if ( abs( fb ) <= errork )
+            return;
+
+        if ( k == MAX_PG_ITERATIONS )
+        {
+            printf( "Warning: the pressure gradient did not converge in %d iterations (bulk velocity error %.3g).\n",
+                    outer_iterations, exp( fb ) - 1 );
+            return;
+        }
+
+        // Secant slope, kept between the turbulent and the laminar power.
+        const double slope = min( max( (fb - fa) / (b - a), 0.5 ), 1.0 );
+
+        a = b;
+        fa = fb;
+
+        b = a - fa / slope;
+        fb = bulkError( b,  u );
+    }
+
+    // Brent's method on the bracket [a, b] (inverse quadratic interpolation,
+    // secant and bisection). pg and u always belong to the last evaluation.
+    double c = a;
+    double fc = fa;
+    double d = b - a;
+    double e = d;
+
+    for ( int k = 0; abs( fb ) > errork && k < MAX_PG_ITERATIONS; k++ )
+    {
+        // Keep the root between b and c, and b the best guess.
+        if ( fb * fc > 0 )
+        {
+            c = a;
+            fc = fa;
+            d = e = b - a;
+        }
+
+        if ( abs( fc ) < abs( fb ) )
+        {
+            a = b;  b = c;  c = a;
+            fa = fb;  fb = fc;  fc = fa;
+        }
+
+        const double tol = 1E-15 * (1 + abs( b ));
+        const double xm = 0.5 * (c - b);
+
+        if ( abs( xm ) <= tol )
+            break;
+
+        if ( abs( e ) >= tol && abs( fa ) > abs( fb ) )
+        {
+            double p, q;
+            const double s = fb / fa;
+
+            if ( a == c )
+            {
+                // Secant
+                p = 2 * xm * s;
+                q = 1 - s;
+            }
+            else
+            {
+                // Inverse quadratic interpolation
+                const double r = fb / fc;
+                const double t = fa / fc;
+                p = s * (2 * xm * t * (t - r) - (b - a) * (r - 1));
+                q = (t - 1) * (r - 1) * (s - 1);
+            }
+
+            if ( p > 0 )
+                q = -q;
+            p = abs( p );
+
+            // Accept the interpolation only if it stays well inside the bracket.
+            if ( 2 * p < min( 3 * xm * q - abs( tol * q ), abs( e * q ) ) )
+            {
+                e = d;
+                d = p / q;
+            }
+            else
+            {
+                d = xm;
+                e = d;
+            }
+        }
+        else
+        {
+            // Bisection
+            d = xm;
+            e = d;
+        }
+
+        a = b;
+        fa = fb;
+
+        if ( abs( d ) > tol )
+            b += d;
+        else
+            b += ( xm > 0 ) ? tol : -tol;
+
+        fb = bulkError( b,  u );
+    }
+
+    if ( abs( fb ) > errork )
+        printf( "Warning: the pressure gradient did not converge in %d iterations (bulk velocity error %.3g).\n",
+                outer_iterations, exp( fb ) - 1 );
 }
 
 double CPModel::froNorm( const ScalarField &new_field, const ScalarField &old_field )
 {
     double sum = 0;
-    int i;
-    for ( i = 0; i < new_field.shape()(0); i++ )
-    {
-        const double & el_new = new_field(i);
-        const double & el_old = old_field(i);
-        if ( el_new > 0)
-            sum += pow2( (el_new - el_old)/el_new );
-    }
-    if ( sum == 0 )
-        return 1.0;
-    else
-        return pow( sum, 0.5 );
+    for ( int i = 0; i < new_field.shape()(0); i++ )
+        sum += froTerm( new_field(i), old_field(i) );
+
+    return froNorm( sum );
+}
+
+void CPModel::finishSweep( ScalarField *u, double *sum, double *defect_sum, double *error )
+{
+    // Set the ghost point
+    setGhost( &work );
+
+    // Get the new error, the sweep summed all but the ghost points.
+    *sum += froTerm( work(0), (*u)(0) ) + froTerm( work(n+1), (*u)(n+1) );
+    *error = froNorm( *sum );
+    *sum = 0;
+
+    // Accelerate. The mixed iterates can be far from the solution while the plain
+    // step from them is small, so the error is the defect of u instead, relative
+    // to pg as in loopMultigrid().
+    if ( anderson != NULL )
+    {
+        *error = sqrt( *defect_sum ) / ( abs( pg ) * sqrt( (double) n ) );
+
+        anderson->mix( *u, &work, *error );
+        setGhost( &work );
+    }
+    *defect_sum = 0;
+
+    // The new profile becomes u, the old one is overwritten by the next sweep.
+    swapFields( u, &work );
 }
 
 void CPModel::setGhost( ScalarField *u )
@@ -211,33 +895,30 @@ void CPModel::setGhost( ScalarField *u )
             (*u)(last) = 2 * wallbv - _u(last-1);
             break;
         case WBC_VEL_GRADIENT:
-            (*u)(last) = wallbv * dy + _u(last+1);
-            (*u)(0)    = wallbv * dy - _u(1);
+            (*u)(last) = wallbv * gap(n) - _u(last-1);
+            (*u)(0)    = wallbv * gap(0) - _u(1);
             break;
     }
 }
 
 
 // Public Methods
-ScalarField CPModel::init( ScalarField u )
+void CPModel::init( ScalarField *u, double pg_guess )
 {
-    // Allocate the y vector and fill it with values.
-    y_mu.resize( n+1 );
-
-    for (int i = 0; i < n+1; i++)
-        y_mu(i) = i * dy;
-
     // Pressure gradient definition
     if ( globbc == GBC_PRESSURE )
     {
         pg = globbv;
-        u = velocityProfile( u );
+        velocityProfile( u );
+        outer_iterations++;
     }
 
-    else if ( globbc == GBC_BULK_VEL )
+    else if ( globbc == GBC_BULK_VEL && solver == SOLVER_JACOBI && coarse == NULL )
     {
-        // Guess a pressure gradient
-        pg = globbv / -400.0;
+        // The Jacobi sweeps stop far from convergence, so a root finder would see the
+        // sweeps instead of the pressure gradient. Rescaling u with pg carries the
+        // sweeps over from one guess to the next.
+        pg = ( pg_guess != 0 ) ? pg_guess : globbv / -400.0;
 
         double error = 1000;
 
@@ -246,21 +927,95 @@ ScalarField CPModel::init( ScalarField u )
         // Loop until the desired bulk velocity is reached.
         while ( error > errork )
         {
-            u = velocityProfile( u );
+            outer_iterations++;
+
+            velocityProfile( u );
 
-            bulk_vel = sum( u ) / n;
+            bulk_vel = grid->mean( *u );
 
             error = abs( (bulk_vel - globbv) / globbv );
 
             // Guess a new pressure gradient, and scale the elements of u
             pg = pg * globbv / bulk_vel;
-            u = u * globbv / bulk_vel;
+            *u = *u * globbv / bulk_vel;
 
             // Set the ghost points to the appropriate values
-            setGhost( &u );
+            setGhost( u );
         }
     }
-    return u;
+
+    else if ( globbc == GBC_BULK_VEL )
+        solvePressureGradient( u, pg_guess );
+
+    printf( "Velocity profile: %d pressure gradient iterations, %d profile iterations (pg = %.5g).\n",
+            outer_iterations, iterations, pg );
+}
+
+double CPModel::frictionVelocity( double u_p, double y_p, double *du_tau )
+{
+    const double u_abs = abs( u_p );
+    const double sign = ( u_p < 0 ) ? -1 : 1;
+
+    if ( u_abs == 0 )
+    {
+        if ( du_tau != NULL )
+            *du_tau = 0;
+        return 0;
+    }
+
+    // Start from the viscous sublayer, u_p = u_tau^2 y_p / nu. Newton on the logarithm
+    // of u_tau u+( y_p u_tau / nu ) = u_p, whose slope stays between 1 and 2.
+    double u_tau = sqrt( nu * u_abs / y_p );
+    double u_plus = 0;
+    double slope = 0;
+
+    for ( int k = 0; k < MAX_WALL_ITERATIONS; k++ )
+    {
+        const double y_plus = y_p * u_tau / nu;
+
+        u_plus = wallLaw( y_plus, &slope );
+
+        const double step = log( u_tau * u_plus / u_abs ) / (1 + y_plus * slope / u_plus);
+        u_tau *= exp( -step );
+
+        if ( abs( step ) <= 1E-12 )
+            break;
+    }
+
+    if ( du_tau != NULL )
+        *du_tau = 1 / (u_plus + y_p * u_tau / nu * slope);
+
+    return sign * u_tau;
+}
+
+double CPModel::wallLaw( double y_plus, double *slope )
+{
+    // Without a turbulent viscosity the flow is laminar all the way.
+    if ( loop_model == LM_SIMPLE || y_plus <= WALL_Y_MIN )
+    {
+        if ( slope != NULL )
+            *slope = 1;
+        return y_plus;
+    }
+
+    // Beyond the table, continue the log law.
+    if ( y_plus >= WALL_Y_MAX )
+    {
+        const double y_last = WALL_Y_MAX;
+        const double g_last = wall_g_plus(WALL_TABLE_SIZE-1);
+
+        if ( slope != NULL )
+            *slope = y_last * g_last / y_plus;
+        return wall_u_plus(WALL_TABLE_SIZE-1) + y_last * g_last * log( y_plus / y_last );
+    }
+
+    const double t = log( y_plus / WALL_Y_MIN ) / wall_step;
+    const int k = min( static_cast<int>( t ), WALL_TABLE_SIZE-2 );
+    const double x = t - k;
+
+    if ( slope != NULL )
+        *slope = (1 - x) * wall_g_plus(k) + x * wall_g_plus(k+1);
+    return (1 - x) * wall_u_plus(k) + x * wall_u_plus(k+1);
 }
 
 double CPModel::prandtlLength( double y )
@@ -19,6 +19,11 @@
 #include "Scrubber.h"
 
 
+// Forward Declarations
+class AndersonMixer;
+class Grid;
+
+
 /**
  * A class providing various methods to calculate a discrete velocity field.
  */
@@ -36,54 +41,253 @@ protected:
     double delta;
     int n;                   /// Number of volumes IN the pipe. Please remember that there are also (half) volumes outside the pipe.
 
+    Grid *grid;              /// Positions of the nodes and faces (--stretch).
+
     // Model
     LoopModel loop_model;
+    ProfileSolver solver;
     double errork;
     double relax;
 
+    AndersonMixer *anderson;  /// Acceleration of the fixed point loops (NULL if off).
+    CPModel *coarse;          /// Model of the next coarser grid (NULL on the coarsest).
+
+    double mu_wall;           /// Viscosity of the wall faces of a coarse grid (0 on the finest: from the profile).
+    double mu_wall_top;
+
     // Boundary conditions
     GlobalBC globbc;
     double globbv;
 
     WallBC wallbc;
     double wallbv;
+    bool wall_function;      /// Wall faces from the law of the wall, see frictionVelocity().
 
     double pg;       /// Pressure gradient (usually negative)
 
+    // Statistics
+    int iterations;        /// Iterations of the loop methods, summed over all profiles.
+    int outer_iterations;  /// Profiles solved to find the pressure gradient.
+
     // Other stuff
     ScalarField y_mu;        /// Array of y values at mu nodes.
+    ScalarField gap;         /// Distance between the velocity nodes around a mu node.
+    ScalarField face_coef;   /// dy / gap, 1 on a uniform grid.
+    ScalarField cell_vol;    /// Width of a volume times dy, dy^2 on a uniform grid.
+
+    // Scratch arrays of the solvers, allocated once. The loops swap u and work by
+    // reference instead of copying.
+    ScalarField work;         /// The other buffer of u.
+    ScalarField newton_step;
+    ScalarField mu_eff;
+    ScalarField lower, diag, upper;
+    ScalarField c_prime;
+    ScalarField tangent;
+    ScalarField res;
+
+    // Multigrid arrays. mg_u, mg_f, mg_r and mg_e of a coarse model are filled by the
+    // finer model (the restricted profile, source and defect, and the correction).
+    ScalarField mg_u, mg_e, mg_p;
+    ScalarField mg_f, mg_d, mg_r;
 
     // Prandtl mixing length constants
     static const double lambda;
     static const double kappa;
 
+    /// Range of y+ of the table of the law of the wall, and its number of points.
+    static const double WALL_Y_MIN;
+    static const double WALL_Y_MAX;
+    static const int WALL_TABLE_SIZE = 4000;
+
+    /// Most Newton iterations for the friction velocity of the wall function.
+    static const int MAX_WALL_ITERATIONS = 50;
+
+    // Law of the wall of the loop model at log spaced y+ (wall function).
+    ScalarField wall_u_plus;  /// u+ at WALL_Y_MIN * exp( k wall_step ).
+    ScalarField wall_g_plus;  /// du+/dy+
+    double wall_step;
+
+    /// Maximum number of profiles solved to find the pressure gradient.
+    static const int MAX_PG_ITERATIONS = 100;
+
+    /// Shortest Newton step of the line search, below it a Picard step is taken.
+    static const double MIN_NEWTON_STEP;
+
+    /// Fewest volumes of a coarse grid.
+    static const int MIN_COARSE_N = 8;
+
+    /// Relaxed Jacobi sweeps before and after the coarse grid correction.
+    static const int SMOOTH_SWEEPS = 2;
+
+    /// Weight of the new values in a smoothing sweep.
+    static const double SMOOTH_WEIGHT;
+
+    /// Weight of the coarse grid correction.
+    static const double CORRECTION_WEIGHT;
+
+    /// Reduction of the defect on the coarsest grid, and the most iterations to get it.
+    static const double COARSEST_REDUCTION;
+    static const int MAX_COARSEST_ITERATIONS = 100;
+
     /**
      * Get the velocity profile by calling one of the loop methods.
-     * @param u  Profile which will be filled.
-     * @return   Velocity profile.
+     * @param u  Profile to start from, replaced by the velocity profile.
      */
-    ScalarField velocityProfile( ScalarField u );
+    void velocityProfile( ScalarField *u );
 
     /**
      * Use the simple model to get a steady solution.
-     * @param u  Profile which will be calculated.
-     * @return   Calculated profile.
+     * @param u  Profile to start from, replaced by the calculated profile.
+     */
+    void loopSimple( ScalarField *u );
+
+    /**
+     * Use a mixing length model (prandtl or Van Driest, see viscosityAt()) to get a steady solution.
+     * @param u  Profile to start from, replaced by the calculated profile.
+     */
+    void loopMixingLength( ScalarField *u );
+
+    /**
+     * End of a sweep of the loop methods (serial): sets the ghost points of work,
+     * finishes the error, accelerates, and swaps work and u.
+     * @param u           The profile of the sweep, replaced by the new profile.
+     * @param sum         The froTerm()s of the sweep, reset to 0.
+     * @param defect_sum  The defectTerm()s of the sweep, reset to 0.
+     * @param error       Receives the error of the sweep.
      */
-    ScalarField loopSimple( ScalarField u );
+    void finishSweep( ScalarField *u, double *sum, double *defect_sum, double *error );
 
     /**
-     * Use the prandtl mixing length model to get a steady solution.
-     * @param u  Profile which will be calculated.
-     * @return   Calculated profile.
+     * Use the Picard iterations with a direct solve to get a steady solution.
+     * The viscosity is frozen, the tridiagonal system of the momentum equation is
+     * solved directly, and then the viscosity is updated.
+     * @param u  Profile to start from, replaced by the calculated profile.
      */
-    ScalarField loopPrandtl( ScalarField u );
+    void loopThomas( ScalarField *u );
 
-     /**
-     * Use the Van Driest model to get a steady solution.
-     * @param u  Profile which will be calculated.
-     * @return   Calculated profile.
+    /**
+     * Use multigrid V-cycles to get a steady solution (--levels).
+     * The Jacobi sweeps only reduce the errors that vary from volume to volume, the
+     * coarser grids correct the smooth ones. Unlike the loop methods, this loops until
+     * the residual (relative to the pressure gradient) is below errork.
+     * @param u  Profile to start from, replaced by the calculated profile.
+     */
+    void loopMultigrid( ScalarField *u );
+
+    /**
+     * One V-cycle of the full approximation scheme (for the nonlinear viscosity).
+     * @param u  Profile, replaced by the improved profile (ghost points set).
+     * @param f  Source of the volumes 1..n (pg on the finest grid).
+     */
+    void vCycle( ScalarField *u, const ScalarField &f );
+
+    /**
+     * Damped Jacobi sweeps of the momentum balance with source f, with the
+     * diagonal of the Jacobian (as the Newton method).
+     * @param u       Profile, replaced by the smoothed profile (ghost points set).
+     * @param f       Source of the volumes 1..n.
+     * @param sweeps  Number of sweeps.
+     */
+    void smooth( ScalarField *u, const ScalarField &f, int sweeps );
+
+    /**
+     * Defect of the momentum balance with source f, per unit of volume.
+     * @param u  The ScalarField of velocities (ghost points set).
+     * @param f  Source of the volumes 1..n.
+     * @param d  Defect of the volumes 1..n.
+     * @return   The 2-norm of the defect.
+     */
+    double defect( const ScalarField &u, const ScalarField &f, ScalarField *d );
+
+    /**
+     * One Picard iteration: freezes the viscosity and solves the tridiagonal system.
+     * @param u     Current profile.
+     * @param unew  The new profile (ghost points set).
+     * @param f     Source of the volumes 1..n (NULL: pg, see loopMultigrid()).
+     */
+    void picardStep( const ScalarField &u, ScalarField *unew, const ScalarField *f = NULL );
+
+    /**
+     * Use Newton-Raphson with line search to get a steady solution.
+     * @param u  Profile to start from, replaced by the calculated profile.
+     */
+    void loopNewton( ScalarField *u );
+
+    /**
+     * Residual of the discretized momentum balance.
+     * @param u    The ScalarField of velocities (ghost points set).
+     * @param res  Residual of the volumes 1..n.
+     * @return     The 2-norm of the residual.
+     */
+    double residual( const ScalarField &u, ScalarField *res );
+
+    /**
+     * Solves a tridiagonal system for the volumes 1..n (Thomas algorithm).
+     * @param lower  Lower diagonal, lower(1) is unused.
+     * @param diag   Diagonal.
+     * @param upper  Upper diagonal, upper(n) is unused.
+     * @param x      Right hand side, overwritten by the solution.
+     */
+    void solveTridiagonal( const ScalarField &lower, const ScalarField &diag,
+                           const ScalarField &upper, ScalarField *x );
+
+    /**
+     * Effective (laminar plus turbulent) viscosity of the loop model.
+     * @param u        The ScalarField of velocities.
+     * @param i        Index of the viscosity point.
+     * @param tangent  If not NULL, receives d(mu_eff * dudy)/d(dudy), for the Newton Jacobian.
+     * @return         The effective viscosity.
      */
-    ScalarField loopVanDriest( ScalarField u );
+    double viscosityAt( const ScalarField &u, int i, double *tangent = NULL );
+
+    /**
+     * Effective viscosity of a face, scaled by the distance between its nodes. The flux
+     * through face i is conductance * (u(i+1) - u(i)) / dy, as on a uniform grid.
+     * @param u        The ScalarField of velocities.
+     * @param i        Index of the viscosity point.
+     * @param tangent  If not NULL, receives the scaled tangent of viscosityAt().
+     * @return         The scaled effective viscosity.
+     */
+    inline double conductanceAt( const ScalarField &u, int i, double *tangent = NULL )
+    {
+        const double mu_eff = viscosityAt( u, i, tangent );
+
+        if ( tangent != NULL )
+            *tangent *= face_coef(i);
+
+        return mu_eff * face_coef(i);
+    }
+
+    /**
+     * Tabulates the law of the wall of the loop model, for the wall function.
+     * Near the wall the shear stress is constant, so (mu + mu_t) du/dy = tau_w, which
+     * gives du+/dy+ at every y+; u+ is its integral.
+     */
+    void fillWallLaw();
+
+    /**
+     * Sum of a ghost point and its neighbour inside the pipe, as set by setGhost().
+     * @return  u(ghost) + u(neighbour).
+     */
+    double ghostSum();
+
+    /**
+     * Error of the bulk velocity for a pressure gradient.
+     * Sets pg and solves the profile, starting from u.
+     * @param log_pg  Logarithm of the magnitude of the pressure gradient.
+     * @param u       Profile to start from, replaced by the solution.
+     * @return        log( bulk velocity / globbv ).
+     */
+    double bulkError( double log_pg, ScalarField *u );
+
+    /**
+     * Finds the pressure gradient of the bulk velocity boundary condition.
+     * Brackets the root, then refines it with Brent's method.
+     * @param u         Profile to start from, replaced by the profile with the desired
+     *                  bulk velocity (pg is set).
+     * @param pg_guess  Pressure gradient to start from (0 to estimate it).
+     */
+    void solvePressureGradient( ScalarField *u, double pg_guess );
 
     /**
      * Calculates the error between two ScalarFields based on the frobenius norm.
@@ -93,6 +297,53 @@ protected:
      */
     double froNorm( const ScalarField &new_field, const ScalarField &old_field );
 
+    /**
+     * The term of one element in froNorm(), for the loops that sum them in their sweep.
+     * @param el_new  New value.
+     * @param el_old  Old value.
+     * @return        The squared relative change (0 unless el_new is positive).
+     */
+    inline double froTerm( double el_new, double el_old )
+    {
+        return ( el_new > 0 ) ? pow2( (el_new - el_old)/el_new ) : 0;
+    }
+
+    /**
+     * The squared defect of the equation of one volume, for the loops that sum them in their sweep.
+     * @param u     The profile.
+     * @param i     Index of the volume.
+     * @param mu_b  Conductance of the bottom face.
+     * @param mu_t  Conductance of the top face.
+     * @return      The squared defect, as in defect() with f = pg.
+     */
+    inline double defectTerm( const ScalarField &u, int i, double mu_b, double mu_t )
+    {
+        return pow2( pg - (mu_t * (u(i+1) - u(i)) - mu_b * (u(i) - u(i-1))) / cell_vol(i) );
+    }
+
+    /**
+     * froNorm() of the summed froTerm()s.
+     * @param sum  Sum of the froTerm()s of all elements.
+     * @return     The relative error.
+     */
+    inline double froNorm( double sum )
+    {
+        return ( sum == 0 ) ? 1.0 : pow( sum, 0.5 );
+    }
+
+    /**
+     * Swaps the arrays of two ScalarFields by reference (nothing is copied).
+     * @param a  A ScalarField.
+     * @param b  Another ScalarField.
+     */
+    static inline void swapFields( ScalarField *a, ScalarField *b )
+    {
+        ScalarField tmp;
+        tmp.reference( *a );
+        a->reference( *b );
+        b->reference( tmp );
+    }
+
     /**
      * Sets the ghost points.
      * Sets the ghost points to satisfy the wall boundary condition.
@@ -110,7 +361,7 @@ protected:
      */
     inline double dudy( const ScalarField &u, int i )
     {
-        return (u(i+1) - u(i))/dy;
+        return (u(i+1) - u(i))/gap(i);
     }
 
 public:
@@ -129,8 +380,36 @@ public:
      * Initialize a ScalarField with values.
      * Generates the velocity profile in the channel by looping until steady, and
      * makes sure the global boundary condition is satisfied.
+     * @param u         Profile to start from (zero, or a nearby profile to save iterations),
+     *                  replaced by the velocity profile.
+     * @param pg_guess  Pressure gradient to start from with the bulk velocity boundary
+     *                  condition (0 to estimate it from globbv).
+     */
+    void init( ScalarField *u, double pg_guess = 0 );
+
+    /**
+     * @return  The pressure gradient of the profile.
+     */
+    double getPressureGradient() const { return pg; }
+
+    /**
+     * Friction velocity of the wall function, for which the law of the wall passes
+     * through the first node.
+     * @param u_p     Velocity at the first node, relative to the wall.
+     * @param y_p     Distance of the first node to the wall.
+     * @param du_tau  If not NULL, receives d(u_tau)/d(u_p).
+     * @return        The friction velocity (with the sign of u_p).
+     */
+    double frictionVelocity( double u_p, double y_p, double *du_tau = NULL );
+
+    /**
+     * The law of the wall of the loop model: linear in the viscous sublayer, and
+     * logarithmic further out.
+     * @param y_plus  Distance to the wall in wall units.
+     * @param slope   If not NULL, receives du+/dy+.
+     * @return        The velocity in wall units.
      */
-    ScalarField init( ScalarField u );
+    double wallLaw( double y_plus, double *slope = NULL );
 
     /**
      * Calculate the Prandtl mixing length.
@@ -16,7 +16,7 @@
 // Headers
 #include "Channel.h"
 
-#include "MTRand.h"
+#include "Random/Random.h"
 
 #include "CPModel.h"
 
@@ -36,10 +36,15 @@ Channel::Channel( const ScrubberParam &param )
     this->conc_b = param.channel.conc_b;
     this->conc_t = param.channel.conc_t;
 
-    this->n = param.channel.n;
-    this->dx = param.channel.dx;
+    this->nu = param.fl.nu;
+    this->wallbv = param.channel.wallbv;
+
+    this->wall_function = param.channel.wall_function;
+    this->u_tau_b = 0;
+    this->u_tau_t = 0;
 
-    this->turb_model = (TurbModel) param.channel.turb_model;
+    this->n = param.channel.n;
+    this->grid = new Grid( radius, n, param.channel.stretch );
 
     this->cpmodel = new CPModel( param );
 
@@ -50,49 +55,71 @@ Channel::Channel( const ScrubberParam &param )
     u = 0;
 }
 
-Channel::~Channel() {}
+Channel::~Channel()
+{
+    delete grid;
+}
 
 
 // Private methods
-double Channel::interpolate2d( const Vector2d &pos )
+void Channel::fillTables()
 {
-    // Position should be located in the channel
-    assert( abs( pos(0) ) <= radius );
-
-    // Start by finding the lower index values of the box surrounding the particle.
-    // Remember that (inherent to the finite volume method) velocities are defined at edges of a volume.
-    int i = static_cast<int> (floor( (pos(0) + radius + 0.5 * dx) / dx ));
-
-    /*
-     * Calculate the weighting factors
-     * Note: 0 <= x < 1
-     * Modulo needs to be done on positive values.
-     */
-    double x = fmod( pos(0) + radius + 0.5 * dx, dx ) / dx;
-
-    //Do a weighted addition
-    return u(i) * (1 - x) + u(i + 1) * x;
+    // Constants of the Discrete Eddy Model
+    const double C_T = 0.3;
+
+    node_l_m.resize( n+2 );
+    cell_dudy.resize( n+1 );
+    cell_t_eddy.resize( n+1 );
+
+    // The mixing length is linear in the distance to the wall, except at its kinks,
+    // so interpolating between the nodes is exact in all other cells (the nodes outside
+    // the channel are extrapolated linearly by prandtlLength).
+    for ( int i = 0; i <= n+1; i++ )
+        node_l_m(i) = cpmodel->prandtlLength( radius - abs( grid->nodeAt( i ) - radius ) );
+
+    for ( int i = 0; i <= n; i++ )
+    {
+        cell_dudy(i) = abs( u(i+1) - u(i) ) * grid->invGapAt( i );
+        cell_t_eddy(i) = C_T / cell_dudy(i);
+    }
+
+    // The friction velocities of the wall function, as CPModel found them.
+    if ( wall_function )
+    {
+        const double y_p = grid->nodeAt( 1 );
+
+        u_tau_b = cpmodel->frictionVelocity( u(1) - wallbv, y_p );
+        u_tau_t = cpmodel->frictionVelocity( u(n) - wallbv, y_p );
+    }
 }
 
-double Channel::dudy( const Vector2d &pos )
+double Channel::wallVelocity( double pos_x )
 {
-    // Start by finding the lower index values of the box surrounding the particle.
-    int i = static_cast<int> (floor( (pos(0) + radius + 0.5 * dx) / dx ));
+    const double u_tau = ( pos_x < 0 ) ? u_tau_b : u_tau_t;
+    const double y_wall = radius - abs( pos_x );
 
-    //Do a weighted addition
-    return (u(i+1) - u(i))/dx;
+    return wallbv + u_tau * cpmodel->wallLaw( y_wall * abs( u_tau ) / nu );
 }
 
 
 // Public methods
 void Channel::init()
 {
-    u = cpmodel->init( u );
+    cpmodel->init( &u );
+    fillTables();
+}
+
+void Channel::init( const ScalarField &guess, double pg_guess )
+{
+    u = guess;
+    cpmodel->init( &u, pg_guess );
+    fillTables();
 }
 
 void Channel::init( const ScalarField &u )
 {
     this->u = u;
+    fillTables();
 }
 
 PosBox Channel::outsideBox( const Vector2d &pos )
@@ -114,29 +141,34 @@ PosBox Channel::outsideBox( const Vector2d &pos )
         return P_INSIDE;
 }
 
-void Channel::velocityAt( const Vector2d &pos, const Vector2d &vel, Vector2d *v_vel, double *count_down )
+template <TurbModel turb>
+void Channel::velocityAt( const Vector2d &pos, const Vector2d &vel, Vector2d *v_vel, double *count_down, Random *random )
 {
-    Vector2d mean_velocity = Vector2d( 0, interpolate2d( pos ) );
+    double x;
+    const int i = cellAt( pos, &x );
 
-    // Random number generator
-    MTRand myran;
+    // Weighted addition of the velocities at the edges of the cell. Between the walls
+    // and the first nodes the velocity follows the wall function instead.
+    const Vector2d mean_velocity( 0, ( wall_function && ( i == 0 || i == n ) ) ? wallVelocity( pos(0) )
+                                                                              : u(i) * (1 - x) + u(i + 1) * x );
 
-    // Readability
-    const double u_acc = cpmodel->prandtlLength( radius - abs( pos(0) ) ) * abs( dudy( pos ) );
-    const double sigma = abs( u_acc );
-
-    if ( turb_model == TURB_NONE )
+    // turb is a compile time constant, so only one of the branches below is compiled in.
+    if ( turb == TURB_NONE )
+    {
         *v_vel = mean_velocity;
+        return;
+    }
 
-    else if ( turb_model == TURB_DISCRETE_EDDY )
-    {
-        // Constants
-        const double C_T = 0.3;
+    // Readability
+    const double u_acc = (node_l_m(i) * (1 - x) + node_l_m(i + 1) * x) * cell_dudy(i);
+    const double sigma = u_acc;
 
-        const Vector2d new_velocity( myran.randNorm( mean_velocity(0), sigma ), myran.randNorm( mean_velocity(1), sigma ) );
+    if ( turb == TURB_DISCRETE_EDDY )
+    {
+        const Vector2d new_velocity( random->randNorm( mean_velocity(0), sigma ), random->randNorm( mean_velocity(1), sigma ) );
 
         // Characteristic times/lengths
-        const double T_eddy = C_T / abs( dudy( pos ) );
+        const double T_eddy = cell_t_eddy(i);
         const double L_eddy = T_eddy * sigma;
         const double T_res = L_eddy / blitz::norm( vel - new_velocity );
 
@@ -144,7 +176,7 @@ void Channel::velocityAt( const Vector2d &pos, const Vector2d &vel, Vector2d *v_
         *v_vel = new_velocity;
     }
 
-    else if ( turb_model == TURB_LANGEVIN )
+    else if ( turb == TURB_LANGEVIN )
     {
         // Readability
         const Vector2d surr_vel = *v_vel;
@@ -165,26 +197,29 @@ void Channel::velocityAt( const Vector2d &pos, const Vector2d &vel, Vector2d *v_
             const double T_Lstar = T_L / sqrt( 1 + pow2( beta * blitz::norm( vel - surr_vel ) / sigma ) );
             const double R_L( exp( -dt / T_Lstar ) );
 
-            Vector2d new_vel( R_L * surr_vel(0) + sqrt( 1 - pow2( R_L ) ) * myran.randNorm( 0, sigma ),
+            Vector2d new_vel( R_L * surr_vel(0) + sqrt( 1 - pow2( R_L ) ) * random->randNorm( 0, sigma ),
                               mean_velocity(1) );
             *v_vel = new_vel;
         }
 
     }
-
-    // FIXME: Checking should be done in parsing of commandline arguments.
-    else
-    {
-        printf( "Unkown turb_model [%d], stopping...\n", turb_model );
-        exit( 1 );
-    }
 }
 
+// The turbulence models the mover can be specialized for.
+template void Channel::velocityAt<TURB_NONE>( const Vector2d &, const Vector2d &, Vector2d *, double *, Random * );
+template void Channel::velocityAt<TURB_DISCRETE_EDDY>( const Vector2d &, const Vector2d &, Vector2d *, double *, Random * );
+template void Channel::velocityAt<TURB_LANGEVIN>( const Vector2d &, const Vector2d &, Vector2d *, double *, Random * );
+
 const ScalarField &Channel::getVelocityField() const
 {
     return u;
 }
 
+double Channel::getPressureGradient() const
+{
+    return cpmodel->getPressureGradient();
+}
+
 double Channel::massFracAt( const Vector2d &pos )
 {
     const double mass_frac_b = (conc_b * co2_density) / (conc_b * co2_density + (1 - conc_b) * fldensity);
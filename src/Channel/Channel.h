@@ -17,10 +17,13 @@
 // Headers
 #include "Typedefs.h"
 #include "Scrubber.h"
+#include "Grid.h"
 
 
 // Forward Declarations
 class CPModel;
+class Grid;
+class Random;
 
 
 /**
@@ -41,29 +44,53 @@ protected:
     double conc_b;
     double conc_t;
 
+    double nu;
+    double wallbv;
+
+    bool wall_function;   /// Analytic profile between the walls and the first nodes (--wallfn).
+    double u_tau_b;       /// Friction velocity at the bottom (x = -radius) wall, with the sign of the flow.
+    double u_tau_t;       /// Friction velocity at the top (x = radius) wall.
+
     int n;
-    double dx;
 
-    TurbModel turb_model;
+    Grid *grid;     /// Positions of the velocity nodes (--stretch).
 
     ScalarField u;
 
+    // Turbulence quantities, filled by fillTables(). Cell i lies between velocity nodes i and i+1.
+    ScalarField node_l_m;     /// Mixing length at every velocity node (interpolated like u).
+    ScalarField cell_dudy;    /// |du/dy| of every cell.
+    ScalarField cell_t_eddy;  /// Eddy lifetime of the Discrete Eddy Model in every cell.
+
     // For filling the velocity profile array.
     CPModel *cpmodel;
 
     /**
-     * Interpolates velocity component u at a certain position.
+     * Finds the cell a position is in.
      * @param pos  Position of the particle.
-     * @return     Velocity u at the position of the particle.
+     * @param x    Position within the cell (0 <= x < 1).
+     * @return     Index i of the cell, between velocity nodes i and i+1.
      */
-    double interpolate2d( const Vector2d &pos );
+    inline int cellAt( const Vector2d &pos, double *x )
+    {
+        // Position should be located in the channel
+        assert( abs( pos(0) ) <= radius );
+
+        // The velocities are defined at the edges of a volume (finite volume method).
+        return grid->locate( pos(0) + radius, x );
+    }
 
     /**
-     * Gets the derivative of the velocity componenent u in the y direction at a certain position.
-     * @param pos  Position of the particle.
-     * @return     Derivative of the velocity compenent u in the y direction.
+     * Fills the turbulence tables from the velocity profile u.
+     */
+    void fillTables();
+
+    /**
+     * Velocity of the wall function, between a wall and its first node.
+     * @param pos_x  Position across the channel.
+     * @return       The velocity of the law of the wall.
      */
-    double dudy( const Vector2d &pos );
+    double wallVelocity( double pos_x );
 
 public:
     /**
@@ -82,6 +109,13 @@ public:
      */
     void init();
 
+    /**
+     * Initialize the channel by calculating the velocity profile, starting from a guess.
+     * @param guess     Profile to start from (n+2 points, like the velocity profile).
+     * @param pg_guess  Pressure gradient to start from (0 to estimate it).
+     */
+    void init( const ScalarField &guess, double pg_guess );
+
     /**
      * Initialize the channel by copying in an existing velocity profile.
      * @param u  The ScalarField to be used as the velocity profile.
@@ -96,13 +130,19 @@ public:
     PosBox outsideBox( const Vector2d &pos );
 
     /**
-     * Get a surrouding fluid velocity of a particle in the channel based on the Discrete Eddy Model.
+     * Get a surrouding fluid velocity of a particle in the channel based on a turbulence model.
+     * Specialized at compile time for every turbulence model (instantiated in Channel.cpp).
+     * TURB_NONE gives the mean velocity and does not use count_down or random.
+     * TURB_LANGEVIN uses the old v_vel, but not count_down.
+     * @param turb         The turbulence model.
      * @param pos          Position of the particle.
      * @param vel          Velocity of the particle.
      * @param *v_vel       Calculated velocity of the surrounding fluid.
      * @param *count_down  Calculated count_down.
+     * @param *random      Random number generator of the particle.
      */
-    void velocityAt( const Vector2d &pos, const Vector2d &vel, Vector2d *v_vel, double *count_down );
+    template <TurbModel turb>
+    void velocityAt( const Vector2d &pos, const Vector2d &vel, Vector2d *v_vel, double *count_down, Random *random );
 
     /**
      * Get the velocity field.
@@ -110,6 +150,12 @@ public:
      */
     const ScalarField &getVelocityField() const;
 
+    /**
+     * Get the pressure gradient of the velocity profile (0 if it wasn't calculated).
+     * @return  The pressure gradient.
+     */
+    double getPressureGradient() const;
+
    /**
     * Gives the mass fraction of CO2 at a certain position.
     * @param pos  Position to get the mass fraction at.
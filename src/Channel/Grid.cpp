@@ -0,0 +1,114 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+// Headers
+#include "Grid.h"
+
+
+// Constructor / Destructor
+Grid::Grid( double radius, int n, double stretch )
+{
+    this->n = n;
+    this->radius = radius;
+    this->stretch = stretch;
+
+    this->dx = radius*2 / n;
+    this->inv_dx = 1 / dx;
+
+    this->tanh_stretch = tanh( stretch );
+
+    node.resize( n+2 );
+    face.resize( n+1 );
+    width.resize( n+1 );
+    gap.resize( n+1 );
+    inv_gap.resize( n+1 );
+
+    width(0) = 0;
+
+    if ( stretch == 0 )
+    {
+        // The nodes and faces of the original uniform discretization (only mean()
+        // differs: it leaves out the ghost points, as on a stretched grid).
+        for ( int i = 0; i <= n; i++ )
+        {
+            face(i) = i * dx;
+            gap(i) = dx;
+            inv_gap(i) = inv_dx;
+        }
+
+        for ( int i = 1; i <= n; i++ )
+            width(i) = dx;
+
+        for ( int i = 0; i <= n+1; i++ )
+            node(i) = (i - 0.5) * dx;
+
+        return;
+    }
+
+    // Symmetric about the center: y = radius (1 + tanh( stretch (2i/n - 1) ) / tanh( stretch )).
+    for ( int i = 0; i <= n; i++ )
+        face(i) = radius * (1 + tanh( stretch * (2.0 * i / n - 1) ) / tanh_stretch);
+
+    face(0) = 0;
+    face(n) = 2 * radius;
+
+    for ( int i = 1; i <= n; i++ )
+    {
+        width(i) = face(i) - face(i-1);
+        node(i) = 0.5 * (face(i-1) + face(i));
+    }
+
+    // The ghost nodes mirror the first nodes in the walls.
+    node(0) = -node(1);
+    node(n+1) = 4 * radius - node(n);
+
+    for ( int i = 0; i <= n; i++ )
+    {
+        gap(i) = node(i+1) - node(i);
+        inv_gap(i) = 1 / gap(i);
+    }
+}
+
+
+// Public Methods
+double Grid::mean( const ScalarField &u ) const
+{
+    // Width-weighted mean of the interior nodes; the ghost points lie in the walls.
+    double total = 0;
+    for ( int i = 1; i <= n; i++ )
+        total += u(i) * width(i);
+
+    return total / (2 * radius);
+}
+
+void Grid::interpolate( const Grid &from_grid, const ScalarField &from, ScalarField *to ) const
+{
+    const double scale = from_grid.radius / radius;
+
+    to->resize( n+2 );
+
+    for ( int j = 0; j <= n+1; j++ )
+    {
+        const double y = node(j) * scale;
+
+        // Outside the outer nodes, extrapolate from the outer two.
+        double x;
+        const int i = min( max( from_grid.locate( y, &x ), 0 ), from_grid.n );
+
+        x = (y - from_grid.node(i)) * from_grid.inv_gap(i);
+
+        (*to)(j) = (1 - x) * from(i) + x * from(i+1);
+    }
+}
@@ -0,0 +1,120 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+// Headers
+#include "Typedefs.h"
+
+
+/**
+ * Grid of the velocity profile across the channel.
+ * The n volumes lie between the walls at y = 0 and y = 2 radius (y = x + radius). The
+ * velocities are defined at the centers of the volumes (nodes 1..n), plus a ghost node
+ * mirrored behind either wall (nodes 0 and n+1), the viscosities at the faces between
+ * the volumes (faces 0..n, face 0 and n on the walls).
+ * With a stretch, the faces follow a tanh, clustering the volumes at the walls to
+ * resolve the viscous layer with few volumes. Without, the volumes are all dx wide.
+ */
+class Grid
+{
+private:
+    int n;
+    double radius;
+    double stretch;   /// Stretch of the tanh (0 = uniform).
+
+    double dx;        /// Mean width of the volumes.
+    double inv_dx;
+
+    double tanh_stretch;
+
+    ScalarField node;     /// Position of the nodes 0..n+1.
+    ScalarField face;     /// Position of the faces 0..n.
+    ScalarField width;    /// Width of the volumes 1..n.
+    ScalarField gap;      /// Distance between node i and i+1 (i = 0..n).
+    ScalarField inv_gap;  /// 1 / gap.
+
+public:
+    /**
+     * Constructor.
+     * @param radius   Radius of the channel.
+     * @param n        Number of volumes.
+     * @param stretch  Stretch of the tanh (0 = uniform).
+     */
+    Grid( double radius, int n, double stretch );
+
+    int getN() const { return n; }
+    double getRadius() const { return radius; }
+    double getStretch() const { return stretch; }
+
+    /**
+     * @return  True if all volumes are dx wide.
+     */
+    bool isUniform() const { return stretch == 0; }
+
+    inline double nodeAt( int i ) const { return node(i); }
+    inline double faceAt( int i ) const { return face(i); }
+    inline double widthAt( int i ) const { return width(i); }
+    inline double gapAt( int i ) const { return gap(i); }
+    inline double invGapAt( int i ) const { return inv_gap(i); }
+
+    /**
+     * Finds the nodes around a position, with the inverse of the mapping (O(1)).
+     * @param y  Position across the channel (0 <= y <= 2 radius; the ghost nodes
+     *           are the outer ends, anything beyond is extrapolated).
+     * @param x  Position between the nodes (0 <= x < 1).
+     * @return   Index i of the nodes i and i+1 around y.
+     */
+    inline int locate( double y, double *x ) const
+    {
+        if ( stretch == 0 )
+        {
+            // The argument is positive, so truncation is the floor.
+            const double s = (y + 0.5 * dx) * inv_dx;
+            const int i = static_cast<int>( s );
+
+            *x = s - i;
+            return i;
+        }
+
+        // Volume k+1 lies between the faces k and k+1 (atanh, which VS2008 lacks). The
+        // ghost nodes lie outside the walls, so y is clamped to find the volume.
+        const double z = (min( max( y, 0.0 ), 2 * radius ) / radius - 1) * tanh_stretch;
+        const double t = 0.5 * n * (1 + 0.5 * log( (1 + z) / (1 - z) ) / stretch);
+        const int k = min( max( static_cast<int>( t ), 0 ), n-1 );
+
+        const int i = ( y < node(k+1) ) ? k : k+1;
+
+        *x = (y - node(i)) * inv_gap(i);
+        return i;
+    }
+
+    /**
+     * Mean of the velocities of the volumes, weighted by their width.
+     * @param u  The velocity profile.
+     * @return   The bulk velocity.
+     */
+    double mean( const ScalarField &u ) const;
+
+    /**
+     * Interpolates a profile of another grid on this grid. The positions are compared
+     * as fractions of the channel width, so the radius may differ. The nodes between
+     * the outer nodes of the other grid are interpolated linearly, the others
+     * extrapolated.
+     * @param from_grid  Grid of the profile.
+     * @param from       The profile (n+2 points of from_grid).
+     * @param to         ScalarField to write the profile of this grid to.
+     */
+    void interpolate( const Grid &from_grid, const ScalarField &from, ScalarField *to ) const;
+};
@@ -16,7 +16,7 @@
 // Headers
 #include "RandomEmitter.h"
 
-#include "MTRand.h"
+#include "Random/Random.h"
 
 #include "Particles/ParticleArray.h"
 #include "Particles/Particle.h"
@@ -29,9 +29,14 @@ RandomEmitter::RandomEmitter( const ScrubberParam &param, Channel *channel ) :
     Emitter( param, channel )
 {
     last_emit_time = 0;
+
+    random = new Random( param.seed, RANDOM_STREAM_EMITTER, 0 );
 }
 
-RandomEmitter::~RandomEmitter() {}
+RandomEmitter::~RandomEmitter()
+{
+    delete random;
+}
 
 
 // Public Methods
@@ -42,10 +47,8 @@ Vector2d RandomEmitter::startPos( int p )
      * particle number; this comes in handy when resetting particles, if
      * they leave the cube, to the position they started;
      */
-    MTRand myran;
-
-    double x = delimiter(0, 0) + (delimiter(0, 1) - delimiter(0, 0)) * myran.rand53();
-    double y = delimiter(1, 0) + (delimiter(1, 1) - delimiter(1, 0)) * myran.rand53();
+    double x = delimiter(0, 0) + (delimiter(0, 1) - delimiter(0, 0)) * random->rand53();
+    double y = delimiter(1, 0) + (delimiter(1, 1) - delimiter(1, 0)) * random->rand53();
 
     return Vector2d( x, y );
 }
@@ -21,6 +21,10 @@
 #include "Scrubber.h"
 
 
+// Forward Declarations
+class Random;
+
+
 /**
  * Emits particles randomly in a specified region.
  */
@@ -30,6 +34,9 @@ protected:
     // Relative time at which the last particles were emitted
     double last_emit_time;
 
+    // Random number generator for the positions.
+    Random *random;
+
     virtual Vector2d startPos( int p );
 
     virtual Vector2d startVel( int p );
@@ -19,6 +19,8 @@
 #include "Particles/ParticleArray.h"
 #include "Particles/Particle.h"
 
+#include <string.h>
+
 
 // Constructor / Destructor
 ByteInOut::ByteInOut( const ScrubberParam &param ) :
@@ -40,80 +42,124 @@ ByteInOut::ByteInOut( const ScrubberParam &param ) :
 
 ByteInOut::~ByteInOut()
 {
+    finishWriting();
+
     if ( outputinfo != OUTPUT_NOTHING )
         fclose( f );
 }
 
 
-// Private Methods
-inline void ByteInOut::writePositions( bool first_call, double time, const ParticleArray &particles )
+// Public Methods
+void ByteInOut::writeFrame( const OutputFrame &frame )
 {
-    if ( first_call )
+    // The whole frame is serialized first, and written with a single fwrite.
+    const size_t header = frame.first ? 2 * 8 : 0;
+    const size_t record = write_ids ? 4 * 8 : 3 * 8;
+    const size_t size = header + 8 + 4 + record * (size_t) frame.length;
+
+    if ( buffer.size() < size )
+        buffer.resize( size );
+
+    char *out = &buffer[0];
+
+    if ( frame.first )
     {
         // Write the and delimiter values to file.
         // i.e. buf[] = { xmin, xmax, ymin, ymax, zmin, zmax }
         double buf[] = { radius, height };
-        fwrite( buf, 8, 2, f );
+        memcpy( out, buf, 2 * 8 );
+        out += 2 * 8;
     }
 
     // Frame data
-    double buf1[] = { time };
-    fwrite( buf1, 8, 1, f );
+    memcpy( out, &frame.time, 8 );
+    out += 8;
 
-    int buf2[] = { particles.getLength() };
-    fwrite( buf2, 4, 1, f );
+    // Records with ids are flagged by a negative count, so the files without them
+    // stay as they were.
+    const int count = write_ids ? -frame.length : frame.length;
+    memcpy( out, &count, 4 );
+    out += 4;
 
-    // Write data
-    for ( int i = 0; i < particles.getLength(); i++ )
-        {
-        // Readability
-        const Vector2d & pos = particles.getParticle( i ).getPos();
-        const double gram = particles.getParticle( i ).getGramCO2();
+    // Records of x, y and gram_co2 (and the id)
+    for ( int i = 0; i < frame.length; i++ )
+    {
+        double buf[] = { frame.x[i], frame.y[i], frame.gram[i] };
+        memcpy( out, buf, 3 * 8 );
+        out += 3 * 8;
 
-        double buf[] = { pos(0), pos(1), gram };
-        fwrite( buf, 8, 3, f );
+        if ( write_ids )
+        {
+            memcpy( out, &frame.id[i], 8 );
+            out += 8;
+        }
     }
-}
 
+    fwrite( &buffer[0], 1, size, f );
+}
 
-// Public Methods
 void ByteInOut::writeScalarField( const ScalarField &scalar_field )
+{
+    writeProfileData( f, dx, radius, n, stretch, scalar_field );
+}
+
+void ByteInOut::readProfile( ScrubberParam *param, ScalarField *u )
+{
+    FILE *f = fopen( param->input.path.c_str(), "rb" );
+    // Skip the file type header
+    fseek( f, 4, SEEK_SET );
+
+    // FIXME: Check if the lenght of the file is sufficient
+    readProfileData( f, &param->channel.dx, &param->channel.radius, &param->channel.n, &param->channel.stretch, u );
+
+    fclose( f );
+}
+
+void ByteInOut::writeProfileData( FILE *f, double dx, double radius, int n, double stretch, const ScalarField &u )
 {
     // Write header
     double buf1[] = { dx, radius };
     fwrite( buf1, 8, 2, f );
 
-    int buf2[] = { n };
+    // A stretched grid is flagged by a negative n, followed by the stretch, so the
+    // files of uniform grids stay as they were.
+    int buf2[] = { ( stretch != 0 ) ? -n : n };
     fwrite( buf2, 4, 1, f );
 
+    if ( stretch != 0 )
+        fwrite( &stretch, 8, 1, f );
+
     // Write the scalar values to file.
-    for ( int i = 0; i < scalar_field.shape()(0); i++ )
+    for ( int i = 0; i < u.shape()(0); i++ )
     {
-        double buf3[] = { scalar_field(i) };
+        double buf3[] = { u(i) };
         fwrite( buf3, 8, 1, f );
      }
 }
 
-void ByteInOut::readProfile( ScrubberParam *param, ScalarField *u )
+bool ByteInOut::readProfileData( FILE *f, double *dx, double *radius, int *n, double *stretch, ScalarField *u )
 {
-    FILE *f = fopen( param->input.path.c_str(), "rb" );
-    // Skip the file type header
-    fseek( f, 4, SEEK_SET );
-
-    // Shut up warnings
-    int nread;
-
     // Read the channel header
-    nread = fread( &param->channel.dx,     8, 1, f );
-    nread = fread( &param->channel.radius, 8, 1, f );
-    nread = fread( &param->channel.n,      4, 1, f );
+    if ( fread( dx,     8, 1, f ) != 1 ||
+         fread( radius, 8, 1, f ) != 1 ||
+         fread( n,      4, 1, f ) != 1 ||
+         *n == 0 )
+        return false;
+
+    *stretch = 0;
+    if ( *n < 0 )
+    {
+        *n = -*n;
+        if ( fread( stretch, 8, 1, f ) != 1 )
+            return false;
+    }
 
-    u->resize( param->channel.n + 2 );
+    u->resize( *n + 2 );
 
-    // FIXME: Check if the lenght of the file is sufficient
     // FIXME: Is there a way to not write the elements iteratively?
     for( int i = 0; i < u->shape()(0); i++ )
-        nread = fread( &(*u)(i), 8, 1, f );
+        if ( fread( &(*u)(i), 8, 1, f ) != 1 )
+            return false;
 
-    fclose( f );
+    return true;
 }
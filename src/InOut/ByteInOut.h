@@ -15,6 +15,7 @@
 #pragma once
 
 // Headers
+#include <vector>
 #include <fstream>
 #include "InOut.h"
 
@@ -28,7 +29,7 @@
 class ByteInOut : public InOut
 {
 protected:
-    virtual void writePositions( bool first_call, double time, const ParticleArray &particles );
+    std::vector<char> buffer;  /// The serialized frame (writer thread only).
 
 public:
     /**
@@ -46,4 +47,29 @@ public:
     virtual void writeScalarField( const ScalarField &scalar_field );
 
     virtual void readProfile( ScrubberParam *param, ScalarField *u );
+
+    virtual void writeFrame( const OutputFrame &frame );
+
+    /**
+     * Write a velocity profile (without the file type header).
+     * @param f       File to write to.
+     * @param dx      Grid size.
+     * @param radius  Radius of the channel.
+     * @param n       Number of volumes.
+     * @param stretch Stretch of the grid (0 = uniform).
+     * @param u       The velocity profile (n+2 values, ghost points included).
+     */
+    static void writeProfileData( FILE *f, double dx, double radius, int n, double stretch, const ScalarField &u );
+
+    /**
+     * Read a velocity profile written by writeProfileData().
+     * @param f       File to read from.
+     * @param dx      Grid size.
+     * @param radius  Radius of the channel.
+     * @param n       Number of volumes.
+     * @param stretch Stretch of the grid (0 for the files without one).
+     * @param u       The velocity profile, resized to n+2.
+     * @return        False if the file ended early.
+     */
+    static bool readProfileData( FILE *f, double *dx, double *radius, int *n, double *stretch, ScalarField *u );
 };
@@ -0,0 +1,122 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+// Headers
+#include "CompressedInOut.h"
+
+
+// Constructor / Destructor
+CompressedInOut::CompressedInOut( const ScrubberParam &param ) :
+                                      ByteInOut( param )
+{
+    this->bits = param.output.bits;
+    this->q_max = quantizedMax( bits );
+    this->prev_length = 0;
+
+    // The rest of the file header, after the file type written by ByteInOut.
+    if ( outputinfo == OUTPUT_POSITIONS )
+    {
+        const int version = COMPRESSED_VERSION;
+        fwrite( &version, 4, 1, f );
+
+        double buf[] = { radius, height };
+        fwrite( buf, 8, 2, f );
+
+        fwrite( &bits, 4, 1, f );
+    }
+}
+
+CompressedInOut::~CompressedInOut()
+{
+    finishWriting();
+}
+
+
+// Public Methods
+void CompressedInOut::writeFrame( const OutputFrame &frame )
+{
+    const int length = frame.length;
+
+    // Range of the amounts of CO2
+    double gram_min = 0;
+    double gram_max = 0;
+
+    if ( length > 0 )
+    {
+        gram_min = gram_max = frame.gram[0];
+
+        for ( int i = 1; i < length; i++ )
+        {
+            gram_min = min( gram_min, frame.gram[i] );
+            gram_max = max( gram_max, frame.gram[i] );
+        }
+    }
+
+    for ( int c = 0; c < 3; c++ )
+        cur_q[c].resize( length );
+
+    for ( int c = 0; c < COMPRESSED_COLUMNS; c++ )
+        models[c].reset();
+
+    data.clear();
+    encoder.start( &data );
+
+    // The ids are increasing (ParticleArray keeps the order of emission), so the
+    // particles of the previous frame are found by walking along with them. The
+    // decoder does the same walk, so the file stays valid if they are not.
+    uint64 last_id = 0;
+    int j = 0;
+
+    for ( int i = 0; i < length; i++ )
+    {
+        const uint64 id = frame.id[i];
+        encoder.encodeInteger( &models[0], zigzag( (long long) ( id - last_id ) ) );
+        last_id = id;
+
+        while ( j < prev_length && prev_id[j] < id )
+            j++;
+
+        const bool known = ( j < prev_length && prev_id[j] == id );
+
+        cur_q[0][i] = quantize( frame.x[i], -radius, radius, q_max );
+        cur_q[1][i] = quantize( frame.y[i], 0, height, q_max );
+        cur_q[2][i] = quantize( frame.gram[i], gram_min, gram_max, q_max );
+
+        for ( int c = 0; c < 3; c++ )
+        {
+            const unsigned long long predicted = known ? prev_q[c][j] : ( i > 0 ? cur_q[c][i - 1] : 0 );
+            encoder.encodeInteger( &models[c + 1], zigzag( (long long) ( cur_q[c][i] - predicted ) ) );
+        }
+    }
+
+    encoder.finish();
+
+    prev_id.assign( frame.id.begin(), frame.id.begin() + length );
+    for ( int c = 0; c < 3; c++ )
+        prev_q[c].swap( cur_q[c] );
+    prev_length = length;
+
+    // Frame header and the coded frame
+    const int size = data.size();
+
+    fwrite( &frame.time, 8, 1, f );
+    fwrite( &frame.length, 4, 1, f );
+
+    double buf[] = { gram_min, gram_max };
+    fwrite( buf, 8, 2, f );
+
+    fwrite( &size, 4, 1, f );
+    fwrite( &data[0], 1, size, f );
+}
@@ -0,0 +1,63 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+// Headers
+#include <vector>
+#include "ByteInOut.h"
+#include "CompressedReader.h"
+#include "RangeCoder.h"
+
+#include "Scrubber.h"
+#include "Typedefs.h"
+
+
+/**
+ * Writes the particles to a compressed trajectory file (see CompressedReader.h): the
+ * positions are quantized to --obits bits relative to the extents of the channel,
+ * coded as differences with the frame before, and range coded. Read the files with
+ * CompressedReader.
+ * The velocity profile is read and written as in ByteInOut.
+ */
+class CompressedInOut : public ByteInOut
+{
+protected:
+    int bits;                  /// Bits per quantized value.
+    unsigned long long q_max;  /// Largest quantized value.
+
+    // Writer thread only
+    std::vector<unsigned char> data;         /// The coded frame.
+    IntegerModel models[COMPRESSED_COLUMNS];
+    RangeEncoder encoder;
+
+    // The quantized values of the previous and the current frame.
+    std::vector<uint64> prev_id;
+    std::vector<unsigned long long> prev_q[3], cur_q[3];
+    int prev_length;
+
+public:
+    /**
+     * Constructor.
+     * @param param  Struct of parameters.
+     */
+    CompressedInOut( const ScrubberParam &param );
+
+    /**
+     * Destructor.
+     */
+    virtual ~CompressedInOut();
+
+    virtual void writeFrame( const OutputFrame &frame );
+};
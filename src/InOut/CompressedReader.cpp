@@ -0,0 +1,163 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+// Headers
+#include "CompressedReader.h"
+
+
+// Constructor / Destructor
+CompressedReader::CompressedReader()
+{
+    this->f = NULL;
+    this->radius = 0;
+    this->height = 0;
+    this->bits = 0;
+    this->prev_length = 0;
+}
+
+CompressedReader::~CompressedReader()
+{
+    close();
+}
+
+
+// Public Methods
+bool CompressedReader::open( const std::string &path )
+{
+    close();
+
+    f = fopen( path.c_str(), "rb" );
+    if ( f == NULL )
+        return false;
+
+    int format, version;
+
+    if ( fread( &format,  4, 1, f ) != 1 || format != COMPRESSED_FORMAT ||
+         fread( &version, 4, 1, f ) != 1 || version != COMPRESSED_VERSION ||
+         fread( &radius,  8, 1, f ) != 1 ||
+         fread( &height,  8, 1, f ) != 1 ||
+         fread( &bits,    4, 1, f ) != 1 || bits < 1 || bits > 32 )
+    {
+        close();
+        return false;
+    }
+
+    prev_length = 0;
+    return true;
+}
+
+void CompressedReader::close()
+{
+    if ( f != NULL )
+        fclose( f );
+
+    f = NULL;
+}
+
+bool CompressedReader::next( CompressedFrame *frame )
+{
+    if ( f == NULL )
+        return false;
+
+    double gram_min, gram_max;
+    int size;
+
+    if ( fread( &frame->time,   8, 1, f ) != 1 ||
+         fread( &frame->length, 4, 1, f ) != 1 || frame->length < 0 ||
+         fread( &gram_min,      8, 1, f ) != 1 ||
+         fread( &gram_max,      8, 1, f ) != 1 ||
+         fread( &size,          4, 1, f ) != 1 || size < 0 )
+        return false;
+
+    data.resize( size + 1 );
+    if ( fread( &data[0], 1, size, f ) != (size_t) size )
+        return false;
+
+    const int length = frame->length;
+    const unsigned long long max = quantizedMax( bits );
+
+    frame->id.resize( length );
+    frame->x.resize( length );
+    frame->y.resize( length );
+    frame->gram.resize( length );
+    frame->gram_error = quantizationError( gram_min, gram_max, max );
+
+    for ( int c = 0; c < 3; c++ )
+        cur_q[c].resize( length );
+
+    for ( int c = 0; c < COMPRESSED_COLUMNS; c++ )
+        models[c].reset();
+
+    RangeDecoder decoder;
+    decoder.start( &data[0], size );
+
+    // The same walk as CompressedInOut::writeFrame().
+    unsigned long long last_id = 0;
+    int j = 0;
+
+    for ( int i = 0; i < length; i++ )
+    {
+        const unsigned long long id = last_id + unzigzag( decoder.decodeInteger( &models[0] ) );
+        frame->id[i] = id;
+        last_id = id;
+
+        while ( j < prev_length && prev_id[j] < id )
+            j++;
+
+        const bool known = ( j < prev_length && prev_id[j] == id );
+
+        for ( int c = 0; c < 3; c++ )
+        {
+            const unsigned long long predicted = known ? prev_q[c][j] : ( i > 0 ? cur_q[c][i - 1] : 0 );
+            cur_q[c][i] = ( predicted + unzigzag( decoder.decodeInteger( &models[c + 1] ) ) ) & max;
+        }
+
+        frame->x[i] = dequantize( cur_q[0][i], -radius, radius, max );
+        frame->y[i] = dequantize( cur_q[1][i], 0, height, max );
+        frame->gram[i] = dequantize( cur_q[2][i], gram_min, gram_max, max );
+    }
+
+    prev_id = frame->id;
+    for ( int c = 0; c < 3; c++ )
+        prev_q[c].swap( cur_q[c] );
+    prev_length = length;
+
+    return true;
+}
+
+double CompressedReader::getRadius() const
+{
+    return radius;
+}
+
+double CompressedReader::getHeight() const
+{
+    return height;
+}
+
+int CompressedReader::getBits() const
+{
+    return bits;
+}
+
+double CompressedReader::getErrorX() const
+{
+    return quantizationError( -radius, radius, quantizedMax( bits ) );
+}
+
+double CompressedReader::getErrorY() const
+{
+    return quantizationError( 0, height, quantizedMax( bits ) );
+}
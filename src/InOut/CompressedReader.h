@@ -0,0 +1,218 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+// Headers
+#include <float.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "RangeCoder.h"
+
+
+// Compressed trajectory files (--oformat 4)
+//
+// All numbers are in the byte order of the machine that wrote the file.
+//
+//   int format, int version             COMPRESSED_FORMAT, COMPRESSED_VERSION.
+//   double radius, double height        Extents of the channel.
+//   int bits                            Bits per quantized value.
+//   Frames:
+//     double time
+//     int length                        Number of particles.
+//     double gram_min, double gram_max  Range of the amounts of CO2 in the frame.
+//     int size                          Number of bytes of the coded frame.
+//     unsigned char data[size]          The range coded frame.
+//
+// Every value is quantized to an integer q in [0, 2^bits - 1]: x over [-radius, radius],
+// y over [0, height], and gram_co2 over [gram_min, gram_max]. A frame codes, per
+// particle, the difference of its id with the id before it, and the differences of
+// its quantized values with a prediction: the particle's values in the frame before
+// (when it was there already, found by id), otherwise the values of the particle
+// before it in this frame (new particles come from the emitter, next to each other).
+// The models of the coder start afresh with every frame.
+
+/// File type, the first four bytes of every output file (INOUT_COMPRESSED).
+const int COMPRESSED_FORMAT = 4;
+
+/// Version of the layout.
+const int COMPRESSED_VERSION = 1;
+
+/// Number of coded columns: id, x, y and gram_co2.
+const int COMPRESSED_COLUMNS = 4;
+
+/**
+ * Largest quantized value.
+ * @param bits  Bits per value (1..32).
+ * @return      2^bits - 1.
+ */
+inline unsigned long long quantizedMax( int bits )
+{
+    return ( 1ULL << bits ) - 1;
+}
+
+/**
+ * Quantize a value in [lo, hi] (clamped to it).
+ * @param value  The value.
+ * @param lo     Lower end of the range.
+ * @param hi     Upper end of the range.
+ * @param max    Largest quantized value.
+ * @return       The nearest of the max + 1 levels, as an integer.
+ */
+inline unsigned long long quantize( double value, double lo, double hi, unsigned long long max )
+{
+    if ( !( hi > lo ) || !( value > lo ) )
+        return 0;
+    if ( value >= hi )
+        return max;
+
+    return (unsigned long long) ( ( value - lo ) / ( hi - lo ) * max + 0.5 );
+}
+
+/**
+ * Value of a quantized integer; within quantizationError() of the original value
+ * when that was in [lo, hi].
+ * @param q    The quantized value.
+ * @param lo   Lower end of the range.
+ * @param hi   Upper end of the range.
+ * @param max  Largest quantized value.
+ * @return     The value.
+ */
+inline double dequantize( unsigned long long q, double lo, double hi, unsigned long long max )
+{
+    if ( !( hi > lo ) )
+        return lo;
+
+    return lo + (double) q * ( ( hi - lo ) / max );
+}
+
+
+/**
+ * Largest difference between a value in [lo, hi] and its dequantized value: half a
+ * level, plus the rounding errors of quantize() and dequantize().
+ * @param lo   Lower end of the range.
+ * @param hi   Upper end of the range.
+ * @param max  Largest quantized value.
+ * @return     The bound.
+ */
+inline double quantizationError( double lo, double hi, unsigned long long max )
+{
+    const double magnitude = ( lo < 0 ? -lo : lo ) + ( hi < 0 ? -hi : hi );
+
+    return ( hi - lo ) / ( 2.0 * max ) + 8 * DBL_EPSILON * magnitude;
+}
+
+
+/**
+ * One decoded frame of a compressed trajectory file.
+ */
+struct CompressedFrame
+{
+    double time;                         /// Absolute time in seconds.
+    int length;                          /// Number of particles.
+    std::vector<unsigned long long> id;  /// Id of every particle.
+    std::vector<double> x;               /// x-coordinate of every particle.
+    std::vector<double> y;               /// y-coordinate of every particle.
+    std::vector<double> gram;            /// Amount of CO2 of every particle.
+    double gram_error;                   /// Largest error of the amounts of CO2 in this frame.
+};
+
+
+/**
+ * Decodes compressed trajectory files, frame by frame.
+ * Every frame is coded relative to the one before it, so the frames can only be
+ * read in order. Does not depend on the rest of Scrubber (make libtrajectory.a).
+ */
+class CompressedReader
+{
+private:
+    FILE *f;
+
+    double radius;
+    double height;
+    int bits;
+
+    std::vector<unsigned char> data;  /// The coded frame.
+    IntegerModel models[COMPRESSED_COLUMNS];
+
+    // The quantized values of the previous and the current frame.
+    std::vector<unsigned long long> prev_id, prev_q[3], cur_q[3];
+    int prev_length;
+
+    // Not copyable, the file is owned by the reader.
+    CompressedReader( const CompressedReader & );
+    CompressedReader &operator=( const CompressedReader & );
+
+public:
+    /**
+     * Constructor.
+     */
+    CompressedReader();
+
+    /**
+     * Destructor, closes the file.
+     */
+    ~CompressedReader();
+
+    /**
+     * Opens a compressed trajectory file (closing the previous one).
+     * @param path  Path to the file.
+     * @return      False if it could not be opened or is not a compressed trajectory file.
+     */
+    bool open( const std::string &path );
+
+    /**
+     * Closes the file.
+     */
+    void close();
+
+    /**
+     * Decodes the next frame.
+     * @param frame  The frame.
+     * @return       False at the end of the file (or when the rest is incomplete).
+     */
+    bool next( CompressedFrame *frame );
+
+    /**
+     * Get the radius of the channel.
+     * @return  The radius of the channel.
+     */
+    double getRadius() const;
+
+    /**
+     * Get the height of the channel.
+     * @return  The height of the channel.
+     */
+    double getHeight() const;
+
+    /**
+     * Get the number of bits per quantized value.
+     * @return  The number of bits.
+     */
+    int getBits() const;
+
+    /**
+     * Largest error of the decoded x-coordinates (see quantizationError()).
+     * @return  The bound.
+     */
+    double getErrorX() const;
+
+    /**
+     * Largest error of the decoded y-coordinates (see quantizationError()).
+     * @return  The bound.
+     */
+    double getErrorY() const;
+};
@@ -0,0 +1,410 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+// Headers
+#include "FloatFormat.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Typedefs.h"
+
+
+// Helper types and functions (all within this file)
+namespace {
+
+typedef unsigned int uint32;
+
+/**
+ * Unnormalized floating point number f * 2^e, with a 64 bit significand.
+ */
+struct DiyFp
+{
+    uint64 f;
+    int e;
+
+    DiyFp( uint64 f, int e ) : f( f ), e( e ) {}
+};
+
+/**
+ * Normalized power of ten f * 2^e = 10^k.
+ */
+struct CachedPower
+{
+    uint64 f;
+    int e;
+    int k;
+};
+
+// 10^k for k = -300, -292, ..., 340, rounded to 64 bits.
+const CachedPower CACHED_POWERS[] = {
+    { 0xAB70FE17C79AC6CAULL, -1060, -300 },
+    { 0xFF77B1FCBEBCDC4FULL, -1034, -292 },
+    { 0xBE5691EF416BD60CULL, -1007, -284 },
+    { 0x8DD01FAD907FFC3CULL,  -980, -276 },
+    { 0xD3515C2831559A83ULL,  -954, -268 },
+    { 0x9D71AC8FADA6C9B5ULL,  -927, -260 },
+    { 0xEA9C227723EE8BCBULL,  -901, -252 },
+    { 0xAECC49914078536DULL,  -874, -244 },
+    { 0x823C12795DB6CE57ULL,  -847, -236 },
+    { 0xC21094364DFB5637ULL,  -821, -228 },
+    { 0x9096EA6F3848984FULL,  -794, -220 },
+    { 0xD77485CB25823AC7ULL,  -768, -212 },
+    { 0xA086CFCD97BF97F4ULL,  -741, -204 },
+    { 0xEF340A98172AACE5ULL,  -715, -196 },
+    { 0xB23867FB2A35B28EULL,  -688, -188 },
+    { 0x84C8D4DFD2C63F3BULL,  -661, -180 },
+    { 0xC5DD44271AD3CDBAULL,  -635, -172 },
+    { 0x936B9FCEBB25C996ULL,  -608, -164 },
+    { 0xDBAC6C247D62A584ULL,  -582, -156 },
+    { 0xA3AB66580D5FDAF6ULL,  -555, -148 },
+    { 0xF3E2F893DEC3F126ULL,  -529, -140 },
+    { 0xB5B5ADA8AAFF80B8ULL,  -502, -132 },
+    { 0x87625F056C7C4A8BULL,  -475, -124 },
+    { 0xC9BCFF6034C13053ULL,  -449, -116 },
+    { 0x964E858C91BA2655ULL,  -422, -108 },
+    { 0xDFF9772470297EBDULL,  -396, -100 },
+    { 0xA6DFBD9FB8E5B88FULL,  -369,  -92 },
+    { 0xF8A95FCF88747D94ULL,  -343,  -84 },
+    { 0xB94470938FA89BCFULL,  -316,  -76 },
+    { 0x8A08F0F8BF0F156BULL,  -289,  -68 },
+    { 0xCDB02555653131B6ULL,  -263,  -60 },
+    { 0x993FE2C6D07B7FACULL,  -236,  -52 },
+    { 0xE45C10C42A2B3B06ULL,  -210,  -44 },
+    { 0xAA242499697392D3ULL,  -183,  -36 },
+    { 0xFD87B5F28300CA0EULL,  -157,  -28 },
+    { 0xBCE5086492111AEBULL,  -130,  -20 },
+    { 0x8CBCCC096F5088CCULL,  -103,  -12 },
+    { 0xD1B71758E219652CULL,   -77,   -4 },
+    { 0x9C40000000000000ULL,   -50,    4 },
+    { 0xE8D4A51000000000ULL,   -24,   12 },
+    { 0xAD78EBC5AC620000ULL,     3,   20 },
+    { 0x813F3978F8940984ULL,    30,   28 },
+    { 0xC097CE7BC90715B3ULL,    56,   36 },
+    { 0x8F7E32CE7BEA5C70ULL,    83,   44 },
+    { 0xD5D238A4ABE98068ULL,   109,   52 },
+    { 0x9F4F2726179A2245ULL,   136,   60 },
+    { 0xED63A231D4C4FB27ULL,   162,   68 },
+    { 0xB0DE65388CC8ADA8ULL,   189,   76 },
+    { 0x83C7088E1AAB65DBULL,   216,   84 },
+    { 0xC45D1DF942711D9AULL,   242,   92 },
+    { 0x924D692CA61BE758ULL,   269,  100 },
+    { 0xDA01EE641A708DEAULL,   295,  108 },
+    { 0xA26DA3999AEF774AULL,   322,  116 },
+    { 0xF209787BB47D6B85ULL,   348,  124 },
+    { 0xB454E4A179DD1877ULL,   375,  132 },
+    { 0x865B86925B9BC5C2ULL,   402,  140 },
+    { 0xC83553C5C8965D3DULL,   428,  148 },
+    { 0x952AB45CFA97A0B3ULL,   455,  156 },
+    { 0xDE469FBD99A05FE3ULL,   481,  164 },
+    { 0xA59BC234DB398C25ULL,   508,  172 },
+    { 0xF6C69A72A3989F5CULL,   534,  180 },
+    { 0xB7DCBF5354E9BECEULL,   561,  188 },
+    { 0x88FCF317F22241E2ULL,   588,  196 },
+    { 0xCC20CE9BD35C78A5ULL,   614,  204 },
+    { 0x98165AF37B2153DFULL,   641,  212 },
+    { 0xE2A0B5DC971F303AULL,   667,  220 },
+    { 0xA8D9D1535CE3B396ULL,   694,  228 },
+    { 0xFB9B7CD9A4A7443CULL,   720,  236 },
+    { 0xBB764C4CA7A44410ULL,   747,  244 },
+    { 0x8BAB8EEFB6409C1AULL,   774,  252 },
+    { 0xD01FEF10A657842CULL,   800,  260 },
+    { 0x9B10A4E5E9913129ULL,   827,  268 },
+    { 0xE7109BFBA19C0C9DULL,   853,  276 },
+    { 0xAC2820D9623BF429ULL,   880,  284 },
+    { 0x80444B5E7AA7CF85ULL,   907,  292 },
+    { 0xBF21E44003ACDD2DULL,   933,  300 },
+    { 0x8E679C2F5E44FF8FULL,   960,  308 },
+    { 0xD433179D9C8CB841ULL,   986,  316 },
+    { 0x9E19DB92B4E31BA9ULL,  1013,  324 },
+    { 0xEB96BF6EBADF77D9ULL,  1039,  332 },
+    { 0xAF87023B9BF0EE6BULL,  1066,  340 },
+};
+
+const int CACHED_POWERS_MIN_K = -300;
+const int CACHED_POWERS_STEP = 8;
+
+// Range of the binary exponent of the scaled numbers: the integral part of the
+// scaled upper boundary then fits in 32 bits.
+const int ALPHA = -60;
+const int GAMMA = -32;
+
+/**
+ * x - y, both with the same exponent, and x >= y.
+ */
+inline DiyFp sub( const DiyFp &x, const DiyFp &y )
+{
+    return DiyFp( x.f - y.f, x.e );
+}
+
+/**
+ * x * y, rounded to the upper 64 bits of the product.
+ */
+inline DiyFp mul( const DiyFp &x, const DiyFp &y )
+{
+    const uint64 x_lo = x.f & 0xFFFFFFFFULL;
+    const uint64 x_hi = x.f >> 32;
+    const uint64 y_lo = y.f & 0xFFFFFFFFULL;
+    const uint64 y_hi = y.f >> 32;
+
+    const uint64 p0 = x_lo * y_lo;
+    const uint64 p1 = x_lo * y_hi;
+    const uint64 p2 = x_hi * y_lo;
+    const uint64 p3 = x_hi * y_hi;
+
+    // The middle part, plus 2^31 to round the lower 64 bits away.
+    const uint64 q = ( p0 >> 32 ) + ( p1 & 0xFFFFFFFFULL ) + ( p2 & 0xFFFFFFFFULL ) + ( 1ULL << 31 );
+
+    return DiyFp( p3 + ( p1 >> 32 ) + ( p2 >> 32 ) + ( q >> 32 ), x.e + y.e + 64 );
+}
+
+/**
+ * Shift x left until the highest bit of the significand is set.
+ */
+inline DiyFp normalize( DiyFp x )
+{
+    while ( ( x.f >> 63 ) == 0 )
+    {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+/**
+ * Shift x left to the (smaller) exponent e.
+ */
+inline DiyFp normalizeTo( const DiyFp &x, int e )
+{
+    return DiyFp( x.f << ( x.e - e ), e );
+}
+
+/**
+ * The cached power c = 10^-k, such that the exponent of c * 2^e is in [ALPHA, GAMMA].
+ */
+inline const CachedPower &cachedPower( int e )
+{
+    // k = ceil( (ALPHA - e - 1) * log10(2) ), 78913 / 2^18 approximates log10(2).
+    const int x = ALPHA - e - 1;
+    const int k = ( x * 78913 ) / ( 1 << 18 ) + ( x > 0 ? 1 : 0 );
+
+    const int index = ( -CACHED_POWERS_MIN_K + k + ( CACHED_POWERS_STEP - 1 ) ) / CACHED_POWERS_STEP;
+
+    return CACHED_POWERS[index];
+}
+
+/**
+ * Number of decimal digits of n (n < 10^10), and the power of ten of the first one.
+ */
+inline int decimalLength( uint32 n, uint32 *pow10 )
+{
+    int digits = 10;
+    *pow10 = 1000000000;
+
+    while ( digits > 1 && n < *pow10 )
+    {
+        digits--;
+        *pow10 /= 10;
+    }
+    return digits;
+}
+
+/**
+ * Moves the last digit down, towards w, as long as the number stays within the
+ * boundaries and gets closer to w.
+ * @param buffer  The digits.
+ * @param length  Number of digits.
+ * @param dist    Distance from the upper boundary to w.
+ * @param delta   Distance between the boundaries.
+ * @param rest    Distance from the upper boundary to the digits.
+ * @param ten_k   Value of one unit of the last digit.
+ */
+inline void roundWeed( char *buffer, int length, uint64 dist, uint64 delta, uint64 rest, uint64 ten_k )
+{
+    while ( rest < dist
+            && delta - rest >= ten_k
+            && ( rest + ten_k < dist || dist - rest > rest + ten_k - dist ) )
+    {
+        buffer[length - 1]--;
+        rest += ten_k;
+    }
+}
+
+/**
+ * Generates the digits of w, as few as are needed to stay between m_minus and
+ * m_plus (the boundaries of w, all scaled by the same power of ten).
+ * @param buffer            Output, the digits (at most 17).
+ * @param length            Number of digits.
+ * @param decimal_exponent  The digits times 10^decimal_exponent give the number,
+ *                          on input the exponent of the scaling.
+ */
+void digitGen( char *buffer, int *length, int *decimal_exponent,
+               const DiyFp &m_minus, const DiyFp &w, const DiyFp &m_plus )
+{
+    uint64 delta = sub( m_plus, m_minus ).f;
+    uint64 dist = sub( m_plus, w ).f;
+
+    // Split m_plus in its integral part p1 and fraction p2, one = 2^-e.
+    const int shift = -m_plus.e;
+    const uint64 one = 1ULL << shift;
+
+    uint32 p1 = (uint32) ( m_plus.f >> shift );
+    uint64 p2 = m_plus.f & ( one - 1 );
+
+    // Digits of the integral part
+    uint32 pow10;
+    int n = decimalLength( p1, &pow10 );
+
+    while ( n > 0 )
+    {
+        const uint32 digit = p1 / pow10;
+        p1 %= pow10;
+        buffer[(*length)++] = (char) ( '0' + digit );
+        n--;
+
+        const uint64 rest = ( (uint64) p1 << shift ) + p2;
+        if ( rest <= delta )
+        {
+            *decimal_exponent += n;
+            roundWeed( buffer, *length, dist, delta, rest, (uint64) pow10 << shift );
+            return;
+        }
+        pow10 /= 10;
+    }
+
+    // Digits of the fraction
+    int m = 0;
+    while ( true )
+    {
+        p2 *= 10;
+        delta *= 10;
+        dist *= 10;
+
+        const uint64 digit = p2 >> shift;
+        p2 &= one - 1;
+        buffer[(*length)++] = (char) ( '0' + digit );
+        m++;
+
+        if ( p2 <= delta )
+            break;
+    }
+
+    *decimal_exponent -= m;
+    roundWeed( buffer, *length, dist, delta, p2, one );
+}
+
+/**
+ * The shortest digits of a positive, finite double (Grisu2).
+ * @param value             The number.
+ * @param buffer            Output, the digits (at most 17).
+ * @param length            Number of digits.
+ * @param decimal_exponent  The digits times 10^decimal_exponent give the number.
+ */
+void grisu2( double value, char *buffer, int *length, int *decimal_exponent )
+{
+    uint64 bits;
+    memcpy( &bits, &value, sizeof(double) );
+
+    const uint64 fraction = bits & 0x000FFFFFFFFFFFFFULL;
+    const int exponent = (int) ( bits >> 52 ) & 0x7FF;
+
+    // value = v.f * 2^v.e (subnormals have no hidden bit)
+    const DiyFp v = ( exponent == 0 ) ? DiyFp( fraction, 1 - 1075 )
+                                      : DiyFp( fraction | ( 1ULL << 52 ), exponent - 1075 );
+
+    // The boundaries are halfway to the neighbouring doubles. Below a power of two
+    // the lower neighbour is twice as close.
+    const bool lower_closer = ( fraction == 0 && exponent > 1 );
+
+    const DiyFp m_plus = normalize( DiyFp( 2 * v.f + 1, v.e - 1 ) );
+    const DiyFp m_minus = normalizeTo( lower_closer ? DiyFp( 4 * v.f - 1, v.e - 2 )
+                                                    : DiyFp( 2 * v.f - 1, v.e - 1 ), m_plus.e );
+    const DiyFp w = normalizeTo( v, m_plus.e );
+
+    // Scale everything by 10^-k, so the exponent is in [ALPHA, GAMMA].
+    const CachedPower &cached = cachedPower( m_plus.e );
+    const DiyFp c( cached.f, cached.e );
+
+    const DiyFp w_scaled = mul( w, c );
+    const DiyFp w_minus = mul( m_minus, c );
+    const DiyFp w_plus = mul( m_plus, c );
+
+    // The products are off by at most one unit, so shrink the interval by one unit.
+    const DiyFp m_minus_safe( w_minus.f + 1, w_minus.e );
+    const DiyFp m_plus_safe( w_plus.f - 1, w_plus.e );
+
+    *length = 0;
+    *decimal_exponent = -cached.k;
+
+    digitGen( buffer, length, decimal_exponent, m_minus_safe, w_scaled, m_plus_safe );
+}
+
+} // namespace
+
+
+// Public Functions
+int formatDouble( double value, char *buffer )
+{
+    // Infinity and NaN
+    if ( value - value != 0 )
+        return sprintf( buffer, "%e", value );
+
+    char *out = buffer;
+
+    if ( value < 0 || ( value == 0 && 1 / value < 0 ) )
+    {
+        *out++ = '-';
+        value = -value;
+    }
+
+    char digits[18];
+    int length = 1;
+    int decimal_exponent = 0;
+
+    if ( value == 0 )
+        digits[0] = '0';
+    else
+        grisu2( value, digits, &length, &decimal_exponent );
+
+    // d.ddd, followed by the exponent of the first digit
+    *out++ = digits[0];
+
+    if ( length > 1 )
+    {
+        *out++ = '.';
+        memcpy( out, digits + 1, length - 1 );
+        out += length - 1;
+    }
+
+    int exponent = decimal_exponent + length - 1;
+
+    *out++ = 'e';
+    *out++ = ( exponent < 0 ) ? '-' : '+';
+
+    if ( exponent < 0 )
+        exponent = -exponent;
+
+    // At least two digits, as printf does.
+    if ( exponent >= 100 )
+    {
+        *out++ = (char) ( '0' + exponent / 100 );
+        exponent %= 100;
+    }
+    *out++ = (char) ( '0' + exponent / 10 );
+    *out++ = (char) ( '0' + exponent % 10 );
+    *out = '\0';
+
+    return (int) ( out - buffer );
+}
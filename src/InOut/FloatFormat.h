@@ -0,0 +1,32 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+
+/// Longest text formatDouble() writes (sign, 17 digits, point, exponent), without the terminating zero.
+const int FORMAT_DOUBLE_MAX = 24;
+
+/**
+ * Writes a double as text in scientific notation (as printf "%e"), with the shortest
+ * number of digits that reads back as exactly the same double.
+ * Uses Grisu2 (Loitsch, "Printing floating-point numbers quickly and accurately with
+ * integers"): only 64-bit integer arithmetic, no locale and no locks, so many threads
+ * can format at the same time. The digits are not always the shortest possible, but
+ * they always round-trip. Infinity and NaN are written by sprintf.
+ * @param value   The number.
+ * @param buffer  Output, at least FORMAT_DOUBLE_MAX + 1 characters, zero-terminated.
+ * @return        Number of characters written (without the terminating zero).
+ */
+int formatDouble( double value, char *buffer );
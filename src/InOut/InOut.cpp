@@ -20,6 +20,8 @@
 #include "Particles/ParticleArray.h"
 #include "Particles/Particle.h"
 
+#include <string.h>
+
 
 // Constructor / Destructor
 InOut::InOut( const ScrubberParam &param )
@@ -31,9 +33,25 @@ InOut::InOut( const ScrubberParam &param )
     this->radius = param.channel.radius;
     this->dx = param.channel.dx;
     this->n = param.channel.n;
+    this->stretch = param.channel.stretch;
+
+    this->write_ids = param.output.ids;
+    this->queue_depth = param.output.queue;
+    this->queue = NULL;
 }
 
-InOut::~InOut() {}
+InOut::~InOut()
+{
+    finishWriting();
+}
+
+
+// Protected Methods
+void InOut::finishWriting()
+{
+    delete queue;
+    queue = NULL;
+}
 
 
 // Public Methods
@@ -46,8 +64,42 @@ void InOut::writeToFile( double time, const ParticleArray &particles )
             // Do nothing.
             break;
         case OUTPUT_POSITIONS:
-            writePositions( first_call, time, particles );
+        {
+            // The writer thread is started with the first frame, so the subclass is
+            // fully constructed (and the readers of profiles never start one).
+            if ( queue == NULL && queue_depth > 0 )
+                queue = new OutputQueue( this, queue_depth );
+
+            OutputFrame *snapshot = ( queue != NULL ) ? queue->acquire() : &frame;
+            const int length = particles.getLength();
+
+            snapshot->first = first_call;
+            snapshot->time = time;
+            snapshot->length = length;
+
+            // Only grows, so the frames are allocated once the particle count levels off.
+            if ( (int) snapshot->x.size() < length )
+            {
+                snapshot->id.resize( length );
+                snapshot->x.resize( length );
+                snapshot->y.resize( length );
+                snapshot->gram.resize( length );
+            }
+
+            if ( length > 0 )
+            {
+                memcpy( &snapshot->x[0], particles.getColumn( PC_POS_X ), length * sizeof(double) );
+                memcpy( &snapshot->y[0], particles.getColumn( PC_POS_Y ), length * sizeof(double) );
+                memcpy( &snapshot->gram[0], particles.getColumn( PC_GRAM_CO2 ), length * sizeof(double) );
+                memcpy( &snapshot->id[0], particles.getIds(), length * sizeof(uint64) );
+            }
+
+            if ( queue != NULL )
+                queue->push();
+            else
+                writeFrame( frame );
             break;
+        }
         default:
             std::cout << "ERROR: Unknown outputtype.";
             break;
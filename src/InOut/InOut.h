@@ -19,6 +19,7 @@
 
 #include "Typedefs.h"
 #include "Scrubber.h"
+#include "OutputQueue.h"
 
 
 // Forward Declarations
@@ -38,16 +39,20 @@ protected:
     double radius;
     double dx;
     int n;
+    double stretch;
+    bool write_ids;  /// Write the id of every particle (--oids).
 
     FILE *f;
 
+    int queue_depth;     /// Frames that can wait for the writer thread (0 = write synchronously).
+    OutputQueue *queue;  /// The frames for the writer thread (NULL until the first frame).
+    OutputFrame frame;   /// The frame when writing synchronously.
+
     /**
-     * Write the positions and concentration of particles to the file.
-     * @param first_call  True if this function is first called.
-     * @param time        Absolute time in seconds.
-     * @param particles   Array of particles.
+     * Write the remaining frames and stop the writer thread.
+     * Has to be called by the destructors of the subclasses before closing the file.
      */
-    virtual void writePositions( bool first_call, double time, const ParticleArray &particles ) = 0;
+    void finishWriting();
 
 public:
     /**
@@ -57,20 +62,27 @@ public:
     InOut( const ScrubberParam &param );
 
     /**
-     * Write the concentration of particles to the file.
-     * @param first_call  True if this function is first called.
-     * @param particles   Array of particles.
+     * Destructor.
      */
     virtual ~InOut();
 
     /**
      * Write output to file.
-     * Based on the choice of the output type, it calls another function that actually writes.
+     * Based on the choice of the output type, it takes a snapshot of the particles
+     * and hands it to the writer thread, which calls writeFrame(). When all frames
+     * in the queue are still waiting to be written, it waits for the writer.
      * @param time       Absolute time in seconds.
      * @param particles  Array of particles.
      */
     void writeToFile( double time, const ParticleArray &particles );
 
+    /**
+     * Write the positions and concentration of the particles in a frame to the file.
+     * Called from the writer thread (or from writeToFile() when writing synchronously).
+     * @param frame  Snapshot of the particles.
+     */
+    virtual void writeFrame( const OutputFrame &frame ) = 0;
+
     /**
      * Write the velocity profile to file.
      * @param scalar_field ScalarField containting the velocity profile.
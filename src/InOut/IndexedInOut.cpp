@@ -0,0 +1,94 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+// Headers
+#include "IndexedInOut.h"
+
+#include <string.h>
+
+
+// Constructor / Destructor
+IndexedInOut::IndexedInOut( const ScrubberParam &param ) :
+                                ByteInOut( param )
+{
+    memset( &header, 0, sizeof(TrajectoryHeader) );
+    header.format = TRAJECTORY_FORMAT;
+    header.version = TRAJECTORY_VERSION;
+    header.radius = radius;
+    header.height = height;
+
+    this->offset = sizeof(TrajectoryHeader);
+
+    // The header replaces the file type header of ByteInOut (it starts with it). Until
+    // the index is written it has none, so a file of an interrupted run can still be read.
+    if ( outputinfo == OUTPUT_POSITIONS )
+    {
+        fseek( f, 0, SEEK_SET );
+        fwrite( &header, sizeof(TrajectoryHeader), 1, f );
+    }
+}
+
+IndexedInOut::~IndexedInOut()
+{
+    finishWriting();
+
+    if ( outputinfo == OUTPUT_POSITIONS )
+    {
+        if ( !index.empty() )
+            fwrite( &index[0], sizeof(TrajectoryIndexEntry), index.size(), f );
+
+        header.n_frames = index.size();
+        header.index_offset = offset;
+
+        fseek( f, 0, SEEK_SET );
+        fwrite( &header, sizeof(TrajectoryHeader), 1, f );
+    }
+}
+
+
+// Public Methods
+void IndexedInOut::writeFrame( const OutputFrame &frame )
+{
+    static const char padding[TRAJECTORY_ALIGNMENT] = { 0 };
+
+    TrajectoryFrameHeader frame_header;
+    memset( &frame_header, 0, sizeof(TrajectoryFrameHeader) );
+    frame_header.time = frame.time;
+    frame_header.length = frame.length;
+
+    TrajectoryIndexEntry entry = { frame.time, frame.length, offset };
+    index.push_back( entry );
+
+    fwrite( &frame_header, sizeof(TrajectoryFrameHeader), 1, f );
+
+    // The columns straight from the snapshot, each padded to the alignment.
+    const size_t column = frame.length * sizeof(double);
+    const size_t column_padding = (size_t) trajectoryColumnSize( frame.length ) - column;
+
+    const std::vector<double> *columns[] = { &frame.x, &frame.y, &frame.gram };
+
+    for ( int c = 0; c < 3; c++ )
+    {
+        if ( frame.length > 0 )
+            fwrite( &(*columns[c])[0], sizeof(double), frame.length, f );
+        fwrite( padding, 1, column_padding, f );
+    }
+
+    if ( frame.length > 0 )
+        fwrite( &frame.id[0], sizeof(uint64), frame.length, f );
+    fwrite( padding, 1, column_padding, f );
+
+    offset += trajectoryFrameSize( frame.length, TRAJECTORY_VERSION );
+}
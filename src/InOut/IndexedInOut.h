@@ -0,0 +1,52 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+// Headers
+#include <vector>
+#include "ByteInOut.h"
+#include "TrajectoryReader.h"
+
+#include "Scrubber.h"
+#include "Typedefs.h"
+
+
+/**
+ * Writes the particles to an indexed trajectory file (see TrajectoryReader.h): every
+ * frame is a set of aligned columns, and the file ends with an index of the frames,
+ * so a TrajectoryReader can map it and go to any frame directly.
+ * The velocity profile is read and written as in ByteInOut.
+ */
+class IndexedInOut : public ByteInOut
+{
+protected:
+    TrajectoryHeader header;                  /// The file header, completed when the file is closed.
+    std::vector<TrajectoryIndexEntry> index;  /// Index of the frames written so far (writer thread only).
+    long long offset;                         /// Offset of the next frame.
+
+public:
+    /**
+     * Constructor.
+     * @param param  Struct of parameters.
+     */
+    IndexedInOut( const ScrubberParam &param );
+
+    /**
+     * Destructor, writes the index.
+     */
+    virtual ~IndexedInOut();
+
+    virtual void writeFrame( const OutputFrame &frame );
+};
@@ -0,0 +1,186 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+// Headers
+#include "OutputQueue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#include "InOut.h"
+
+
+// Semaphore
+#ifdef _WIN32
+
+Semaphore::Semaphore( int count )
+{
+    this->handle = CreateSemaphore( NULL, count, 0x7fffffff, NULL );
+
+    if ( handle == NULL )
+    {
+        printf( "Error in creating a semaphore, exiting\n" );
+        exit( 1 );
+    }
+}
+
+Semaphore::~Semaphore()
+{
+    CloseHandle( handle );
+}
+
+void Semaphore::wait()
+{
+    WaitForSingleObject( handle, INFINITE );
+}
+
+void Semaphore::post()
+{
+    ReleaseSemaphore( handle, 1, NULL );
+}
+
+#else
+
+Semaphore::Semaphore( int count )
+{
+    if ( sem_init( &sem, 0, count ) != 0 )
+    {
+        printf( "Error in creating a semaphore, exiting\n" );
+        exit( 1 );
+    }
+}
+
+Semaphore::~Semaphore()
+{
+    sem_destroy( &sem );
+}
+
+void Semaphore::wait()
+{
+    // Retry when interrupted by a signal.
+    while ( sem_wait( &sem ) != 0 ) {}
+}
+
+void Semaphore::post()
+{
+    sem_post( &sem );
+}
+
+#endif
+
+
+// Constructor / Destructor
+OutputQueue::OutputQueue( InOut *inout, int depth ) :
+                              free_frames( depth ),
+                              filled_frames( 0 )
+{
+    this->inout = inout;
+    this->frames.resize( depth );
+    this->head = 0;
+    this->tail = 0;
+
+#ifdef _WIN32
+    this->thread = CreateThread( NULL, 0, threadMain, this, 0, NULL );
+    this->running = ( thread != NULL );
+#else
+    this->running = ( pthread_create( &thread, NULL, threadMain, this ) == 0 );
+#endif
+
+    if ( !running )
+    {
+        printf( "Error in starting the output thread, exiting\n" );
+        exit( 1 );
+    }
+}
+
+OutputQueue::~OutputQueue()
+{
+    finish();
+}
+
+
+// Private Methods
+void OutputQueue::run()
+{
+    while ( true )
+    {
+        filled_frames.wait();
+
+        OutputFrame &frame = frames[tail];
+        tail = ( tail + 1 ) % frames.size();
+
+        if ( frame.stop )
+            break;
+
+        inout->writeFrame( frame );
+
+        free_frames.post();
+    }
+}
+
+#ifdef _WIN32
+unsigned long __stdcall OutputQueue::threadMain( void *queue )
+{
+    static_cast<OutputQueue *>( queue )->run();
+    return 0;
+}
+#else
+void *OutputQueue::threadMain( void *queue )
+{
+    static_cast<OutputQueue *>( queue )->run();
+    return NULL;
+}
+#endif
+
+
+// Public Methods
+OutputFrame *OutputQueue::acquire()
+{
+    free_frames.wait();
+
+    OutputFrame *frame = &frames[head];
+    frame->stop = false;
+    return frame;
+}
+
+void OutputQueue::push()
+{
+    head = ( head + 1 ) % frames.size();
+    filled_frames.post();
+}
+
+void OutputQueue::finish()
+{
+    if ( !running )
+        return;
+
+    // The stop frame is queued behind the frames that still have to be written.
+    acquire()->stop = true;
+    push();
+
+#ifdef _WIN32
+    WaitForSingleObject( thread, INFINITE );
+    CloseHandle( thread );
+#else
+    pthread_join( thread, NULL );
+#endif
+
+    running = false;
+}
@@ -0,0 +1,162 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+// Headers
+#include <vector>
+
+#include "Typedefs.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+
+
+// Forward Declarations
+class InOut;
+
+
+/**
+ * Snapshot of the particles of one output frame.
+ * The ids, positions and concentrations are copied column by column, so the simulation
+ * can move on while the frame is being written.
+ */
+struct OutputFrame
+{
+    bool first;                /// True for the first frame of the file.
+    bool stop;                 /// True for the frame that stops the writer thread.
+    double time;               /// Absolute time in seconds.
+    int length;                /// Number of particles.
+    std::vector<uint64> id;    /// Id of every particle.
+    std::vector<double> x;     /// x-coordinate of every particle.
+    std::vector<double> y;     /// y-coordinate of every particle.
+    std::vector<double> gram;  /// Amount of CO2 of every particle.
+};
+
+
+/**
+ * Counting semaphore (Win32 or POSIX).
+ */
+class Semaphore
+{
+private:
+#ifdef _WIN32
+    void *handle;
+#else
+    sem_t sem;
+#endif
+
+    // Not copyable.
+    Semaphore( const Semaphore & );
+    Semaphore &operator=( const Semaphore & );
+
+public:
+    /**
+     * Constructor.
+     * @param count  Initial count.
+     */
+    Semaphore( int count );
+
+    /**
+     * Destructor.
+     */
+    ~Semaphore();
+
+    /**
+     * Decrement the count, wait while it is zero.
+     */
+    void wait();
+
+    /**
+     * Increment the count, waking up a waiting thread.
+     */
+    void post();
+};
+
+
+/**
+ * Bounded queue of output frames, written by a separate thread.
+ * The main loop acquires a free frame, fills it and pushes it, and continues stepping
+ * while the writer thread hands the frame to InOut::writeFrame(). The frames are a
+ * ring that is allocated once; when all of them are still waiting to be written,
+ * acquire() blocks until the writer has caught up.
+ * There is only one producer and one consumer, so the two semaphores (free and
+ * filled frames) are all the synchronization needed.
+ */
+class OutputQueue
+{
+private:
+    InOut *inout;  /// The writer of the frames.
+
+    std::vector<OutputFrame> frames;  /// Ring of frames.
+    int head;                         /// Next frame to fill (main thread only).
+    int tail;                         /// Next frame to write (writer thread only).
+
+    Semaphore free_frames;    /// Number of frames that can be filled.
+    Semaphore filled_frames;  /// Number of frames waiting to be written.
+
+    bool running;  /// True while the writer thread runs.
+
+#ifdef _WIN32
+    void *thread;
+#else
+    pthread_t thread;
+#endif
+
+    // Not copyable.
+    OutputQueue( const OutputQueue & );
+    OutputQueue &operator=( const OutputQueue & );
+
+    /**
+     * Body of the writer thread: writes the frames until the stop frame.
+     */
+    void run();
+
+#ifdef _WIN32
+    static unsigned long __stdcall threadMain( void *queue );
+#else
+    static void *threadMain( void *queue );
+#endif
+
+public:
+    /**
+     * Constructor, starts the writer thread.
+     * @param inout  The writer of the frames.
+     * @param depth  Number of frames that can wait to be written.
+     */
+    OutputQueue( InOut *inout, int depth );
+
+    /**
+     * Destructor, writes the remaining frames and stops the writer thread.
+     */
+    ~OutputQueue();
+
+    /**
+     * Get the next frame to fill, waits while all frames are waiting to be written.
+     * @return  The frame, to be handed to push() when filled.
+     */
+    OutputFrame *acquire();
+
+    /**
+     * Hand the frame from acquire() to the writer thread.
+     */
+    void push();
+
+    /**
+     * Write the remaining frames and stop the writer thread.
+     */
+    void finish();
+};
@@ -0,0 +1,319 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+// Headers
+#include "ProfileCache.h"
+
+#include "ByteInOut.h"
+#include "Channel/Grid.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#include <process.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+
+// Constants
+const char ProfileCache::FILE_MAGIC[8] = { 'S', 'C', 'R', 'B', 'P', 'R', 'O', 'F' };
+const double ProfileCache::N_WEIGHT = 0.01;
+
+
+// Constructor / Destructor
+ProfileCache::ProfileCache( const ScrubberParam &param )
+{
+    this->dir = param.cache;
+
+    this->dx = param.channel.dx;
+    this->radius = param.channel.radius;
+    this->n = param.channel.n;
+    this->stretch = param.channel.stretch;
+
+    // Zero the padding too, the key is hashed and compared as bytes.
+    memset( &key, 0, sizeof( key ) );
+
+    key.radius = param.channel.radius;
+    key.mu = param.fl.mu;
+    key.rho = param.fl.density;
+    key.errork = param.errork;
+    key.relax = param.relax;
+    key.wallbv = param.channel.wallbv;
+    key.globbv = param.channel.globbv;
+    key.stretch = param.channel.stretch;
+
+    key.n = param.channel.n;
+    key.loop_model = param.channel.loop_model;
+    key.solver = param.channel.solver;
+    key.anderson = param.anderson;
+    key.levels = param.levels;
+    key.wallbc = param.channel.wallbc;
+    key.globbc = param.channel.globbc;
+    key.wall_function = param.channel.wall_function;
+
+    this->key_hash = hash( &key, sizeof( key ) );
+
+    char name[64];
+    sprintf( name, "profile_%016llx.data", key_hash );
+    this->path = dir + "/" + name;
+}
+
+
+// Private Methods
+uint64 ProfileCache::hash( const void *data, size_t length, uint64 hash )
+{
+    const unsigned char *bytes = (const unsigned char *) data;
+
+    for ( size_t i = 0; i < length; i++ )
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64 ProfileCache::hashProfile( const ScalarField &u )
+{
+    uint64 h = hash( NULL, 0 );
+
+    for ( int i = 0; i < u.shape()(0); i++ )
+    {
+        const double value = u(i);
+        h = hash( &value, sizeof( value ), h );
+    }
+    return h;
+}
+
+bool ProfileCache::readFile( const string &file, Header *header, ScalarField *u )
+{
+    FILE *f = fopen( file.c_str(), "rb" );
+    if ( !f )
+        return false;
+
+    int format;
+    double file_dx, file_radius, file_stretch;
+    int file_n;
+
+    // Every check has to pass, otherwise the file is not used.
+    bool valid = fread( header, sizeof( *header ), 1, f ) == 1 &&
+                 memcmp( header->magic, FILE_MAGIC, sizeof( FILE_MAGIC ) ) == 0 &&
+                 header->version == FILE_VERSION &&
+                 fread( &format, 4, 1, f ) == 1 &&
+                 format == INOUT_BYTE &&
+                 ByteInOut::readProfileData( f, &file_dx, &file_radius, &file_n, &file_stretch, u ) &&
+                 file_n == header->key.n &&
+                 file_stretch == header->key.stretch &&
+                 header->length == file_n + 2 &&
+                 header->data_hash == hashProfile( *u );
+
+    fclose( f );
+    return valid;
+}
+
+void ProfileCache::listFiles( std::vector<string> *files )
+{
+#ifdef _WIN32
+    _finddata_t info;
+    intptr_t handle = _findfirst( (dir + "/profile_*.data").c_str(), &info );
+
+    if ( handle == -1 )
+        return;
+
+    do
+        files->push_back( dir + "/" + info.name );
+    while ( _findnext( handle, &info ) == 0 );
+
+    _findclose( handle );
+#else
+    DIR *d = opendir( dir.c_str() );
+    if ( !d )
+        return;
+
+    while ( dirent *entry = readdir( d ) )
+    {
+        // profile_<hash>.data (not the temporary files of writers).
+        const string name = entry->d_name;
+        if ( name.compare( 0, 8, "profile_" ) == 0 && name.size() > 13 &&
+             name.compare( name.size() - 5, 5, ".data" ) == 0 )
+            files->push_back( dir + "/" + name );
+    }
+
+    closedir( d );
+#endif
+}
+
+double ProfileCache::distance( const Key &other )
+{
+    // The profile has to be of the same model, and driven in the same direction.
+    if ( other.loop_model != key.loop_model || other.globbc != key.globbc ||
+         other.wallbc != key.wallbc || other.wallbv != key.wallbv ||
+         other.wall_function != key.wall_function ||
+         other.globbv * key.globbv <= 0 )
+        return -1;
+
+    return pow2( log( other.radius / key.radius ) ) +
+           pow2( log( other.mu / key.mu ) ) +
+           pow2( log( other.rho / key.rho ) ) +
+           pow2( log( other.globbv / key.globbv ) ) +
+           N_WEIGHT * pow2( log( (double) other.n / key.n ) ) +
+           N_WEIGHT * pow2( other.stretch - key.stretch );
+}
+
+
+// Public Methods
+bool ProfileCache::read( ScalarField *u )
+{
+    if ( !enabled() )
+        return false;
+
+    FILE *f = fopen( path.c_str(), "rb" );
+    if ( !f )
+        return false;
+    fclose( f );
+
+    // The file has to be valid and of our parameters, otherwise the profile is computed
+    // (and the file replaced).
+    Header header;
+    if ( readFile( path, &header, u ) && memcmp( &header.key, &key, sizeof( key ) ) == 0 )
+        return true;
+
+    printf( "Ignoring invalid cached profile %s.\n", path.c_str() );
+    return false;
+}
+
+bool ProfileCache::readNearest( ScalarField *u, double *pg )
+{
+    if ( !enabled() )
+        return false;
+
+    std::vector<string> files;
+    listFiles( &files );
+
+    Header best;
+    memset( &best, 0, sizeof( best ) );
+    ScalarField best_u;
+    string best_file;
+    double best_distance = -1;
+
+    for ( size_t k = 0; k < files.size(); k++ )
+    {
+        Header header;
+        ScalarField file_u;
+
+        if ( !readFile( files[k], &header, &file_u ) )
+            continue;
+
+        const double d = distance( header.key );
+        if ( d >= 0 && ( best_distance < 0 || d < best_distance ) )
+        {
+            best = header;
+            best_u.reference( file_u );
+            best_file = files[k];
+            best_distance = d;
+        }
+    }
+
+    if ( best_distance < 0 )
+        return false;
+
+    // Scale as turbulent flow, where the wall shear stress (pg times the radius) goes
+    // as rho times the velocity squared.
+    const Key &other = best.key;
+
+    Grid( radius, n, stretch ).interpolate( Grid( other.radius, other.n, other.stretch ), best_u, u );
+    double scale;
+
+    if ( key.globbc == GBC_BULK_VEL )
+    {
+        scale = key.globbv / other.globbv;
+        *pg = best.pg * pow2( scale ) * (key.rho / other.rho) * (other.radius / key.radius);
+    }
+    else
+    {
+        scale = sqrt( (key.globbv / other.globbv) * (other.rho / key.rho) * (key.radius / other.radius) );
+        *pg = key.globbv;
+    }
+
+    for ( int j = 0; j <= n+1; j++ )
+        (*u)(j) *= scale;
+
+    printf( "Velocity profile started from %s (n = %d).\n", best_file.c_str(), other.n );
+    return true;
+}
+
+bool ProfileCache::write( const ScalarField &u, double pg )
+{
+    if ( !enabled() )
+        return false;
+
+#ifdef _WIN32
+    _mkdir( dir.c_str() );
+    const int pid = _getpid();
+#else
+    mkdir( dir.c_str(), 0777 );
+    const int pid = getpid();
+#endif
+
+    // A temporary name of our own, so concurrent writers never share a file.
+    char suffix[32];
+    sprintf( suffix, ".tmp%d", pid );
+    const string tmp_path = path + suffix;
+
+    FILE *f = fopen( tmp_path.c_str(), "wb" );
+    if ( !f )
+    {
+        printf( "Could not write the profile cache %s.\n", tmp_path.c_str() );
+        return false;
+    }
+
+    Header header;
+    memset( &header, 0, sizeof( header ) );
+
+    memcpy( header.magic, FILE_MAGIC, sizeof( FILE_MAGIC ) );
+    header.version = FILE_VERSION;
+    header.length = u.shape()(0);
+    header.data_hash = hashProfile( u );
+    header.pg = pg;
+    header.key = key;
+
+    const int format = INOUT_BYTE;
+
+    fwrite( &header, sizeof( header ), 1, f );
+    fwrite( &format, 4, 1, f );
+    ByteInOut::writeProfileData( f, dx, radius, n, stretch, u );
+
+    const bool written = !ferror( f );
+    if ( fclose( f ) != 0 || !written )
+    {
+        remove( tmp_path.c_str() );
+        return false;
+    }
+
+    // Renaming is atomic. If another run got there first (rename doesn't replace
+    // files on Windows) its profile is the same, so ours is dropped.
+    if ( rename( tmp_path.c_str(), path.c_str() ) != 0 )
+    {
+        remove( tmp_path.c_str() );
+        return false;
+    }
+    return true;
+}
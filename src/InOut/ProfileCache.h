@@ -0,0 +1,168 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+// Headers
+#include <stdio.h>
+#include <vector>
+
+#include "Typedefs.h"
+#include "Scrubber.h"
+
+
+/**
+ * Cache of velocity profiles on disk (--cache <dir>).
+ * A profile depends only on the channel, the fluid and the settings of CPModel, so
+ * runs that differ in anything else (particles, emitter, integrator) can share it.
+ * Every profile is stored in its own file, named after a hash of those parameters.
+ * The file holds a validation header and then the profile in the ByteInOut format.
+ * Writers write to a temporary file and rename it, so readers only see complete
+ * files, and concurrent runs computing the same profile don't corrupt each other.
+ * Without an exact match, the nearest profile of the same model (another n, bulk
+ * velocity, grid or fluid) is resampled and scaled into a guess to start the solver from.
+ */
+class ProfileCache
+{
+private:
+    /// Parameters that determine the velocity profile.
+    struct Key
+    {
+        double radius;
+        double mu;
+        double rho;
+        double errork;
+        double relax;
+        double wallbv;
+        double globbv;
+        double stretch;
+
+        int n;
+        int loop_model;
+        int solver;
+        int anderson;
+        int levels;
+        int wallbc;
+        int globbc;
+        int wall_function;
+    };
+
+    /// Validation header of a cache file.
+    struct Header
+    {
+        char magic[8];     /// FILE_MAGIC
+        int version;       /// FILE_VERSION
+        int length;        /// Number of values in the profile.
+        uint64 data_hash;  /// Hash of the values.
+        double pg;         /// Pressure gradient of the profile.
+        Key key;           /// The parameters (guards against hash collisions).
+    };
+
+    static const char FILE_MAGIC[8];
+    static const int FILE_VERSION = 5;
+
+    /// Weight of a different n or stretch in the distance between keys (resampling is cheap).
+    static const double N_WEIGHT;
+
+    string dir;     /// Directory of the cache (empty if off).
+    string path;    /// Path of the file of this profile.
+
+    Key key;
+    uint64 key_hash;
+
+    double dx;
+    double radius;
+    int n;
+    double stretch;
+
+    /**
+     * 64 bit FNV-1a hash.
+     * @param data    Bytes to hash.
+     * @param length  Number of bytes.
+     * @param hash    Hash to continue from.
+     * @return        The hash.
+     */
+    static uint64 hash( const void *data, size_t length, uint64 hash = 14695981039346656037ULL );
+
+    /**
+     * Hash of the values of a profile.
+     * @param u  The profile.
+     * @return   The hash.
+     */
+    static uint64 hashProfile( const ScalarField &u );
+
+    /**
+     * Reads and validates a cache file (everything but the key).
+     * @param file    Path of the file.
+     * @param header  Receives the header.
+     * @param u       ScalarField to write the velocities to.
+     * @return        False if the file can't be read or is invalid.
+     */
+    static bool readFile( const string &file, Header *header, ScalarField *u );
+
+    /**
+     * Lists the cache files in the cache directory.
+     * @param files  Receives the paths.
+     */
+    void listFiles( std::vector<string> *files );
+
+    /**
+     * Distance between the key of a cached profile and ours.
+     * @param other  Key of the cached profile.
+     * @return       The distance, negative if the profile is no use as a guess.
+     */
+    double distance( const Key &other );
+
+public:
+    /**
+     * Constructor.
+     * @param param  Struct of parameters.
+     */
+    ProfileCache( const ScrubberParam &param );
+
+    /**
+     * @return  True if a cache directory was given.
+     */
+    bool enabled() const { return !dir.empty(); }
+
+    /**
+     * @return  Path of the file of this profile.
+     */
+    const string &getPath() const { return path; }
+
+    /**
+     * Read the profile from the cache.
+     * @param u  ScalarField to write the velocities to.
+     * @return   False if it isn't cached (or the file is invalid).
+     */
+    bool read( ScalarField *u );
+
+    /**
+     * Make a guess from the nearest profile in the cache.
+     * The profile is resampled to our grid, and scaled to our bulk velocity (or pressure
+     * gradient) and fluid as turbulent flow.
+     * @param u   ScalarField to write the guess to.
+     * @param pg  Receives the guess of the pressure gradient.
+     * @return    False if the cache holds no profile of the same model.
+     */
+    bool readNearest( ScalarField *u, double *pg );
+
+    /**
+     * Store the profile in the cache.
+     * @param u   The velocity profile.
+     * @param pg  Its pressure gradient.
+     * @return    False if it couldn't be written.
+     */
+    bool write( const ScalarField &u, double pg );
+};
@@ -0,0 +1,302 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+// Headers
+#include <stddef.h>
+#include <vector>
+
+
+/**
+ * Adaptive probability of a bit being zero, in units of 1/2048.
+ */
+typedef unsigned short BitModel;
+
+const int BIT_MODEL_BITS = 11;
+const int BIT_MODEL_SHIFT = 5;     /// Adaptation speed (1/32 of the distance per bit).
+const BitModel BIT_MODEL_INIT = 1 << ( BIT_MODEL_BITS - 1 );
+
+
+/**
+ * Adaptive models of a stream of unsigned integers.
+ * An integer is coded as its bit length (0..64, by a bit tree), the bit below its
+ * highest one (modelled per length), and the remaining bits as they are. Small
+ * integers, such as the differences between frames, thus take few bits, and the
+ * models learn which lengths are common.
+ */
+struct IntegerModel
+{
+    BitModel length[128];  /// Bit tree of the bit length.
+    BitModel second[65];   /// The bit below the highest one, per length.
+
+    /**
+     * Back to equal probabilities.
+     */
+    void reset()
+    {
+        for ( int i = 0; i < 128; i++ )
+            length[i] = BIT_MODEL_INIT;
+        for ( int i = 0; i < 65; i++ )
+            second[i] = BIT_MODEL_INIT;
+    }
+};
+
+/**
+ * Maps signed to unsigned integers, small magnitudes to small numbers (0, -1, 1, -2 ...).
+ */
+inline unsigned long long zigzag( long long v )
+{
+    return ( (unsigned long long) v << 1 ) ^ (unsigned long long) ( v >> 63 );
+}
+
+inline long long unzigzag( unsigned long long v )
+{
+    return (long long) ( v >> 1 ) ^ -(long long) ( v & 1 );
+}
+
+
+/**
+ * Binary range encoder (as in LZMA), writes to a byte vector.
+ */
+class RangeEncoder
+{
+private:
+    std::vector<unsigned char> *out;
+    unsigned long long low;
+    unsigned int range;
+    unsigned char cache;
+    unsigned long long cache_size;
+
+    inline void shiftLow()
+    {
+        // Carry propagation: bytes of 0xFF are held back until the carry is known.
+        if ( (unsigned int) low < 0xFF000000u || ( low >> 32 ) != 0 )
+        {
+            const unsigned char carry = (unsigned char) ( low >> 32 );
+            unsigned char temp = cache;
+            do
+            {
+                out->push_back( (unsigned char) ( temp + carry ) );
+                temp = 0xFF;
+            }
+            while ( --cache_size != 0 );
+            cache = (unsigned char) ( low >> 24 );
+        }
+        cache_size++;
+        low = ( low & 0x00FFFFFFu ) << 8;
+    }
+
+    inline void normalize()
+    {
+        while ( range < ( 1u << 24 ) )
+        {
+            range <<= 8;
+            shiftLow();
+        }
+    }
+
+public:
+    /**
+     * Start encoding.
+     * @param out  The bytes are appended to this vector.
+     */
+    void start( std::vector<unsigned char> *out )
+    {
+        this->out = out;
+        this->low = 0;
+        this->range = 0xFFFFFFFFu;
+        this->cache = 0;
+        this->cache_size = 1;
+    }
+
+    /**
+     * Write the last bytes.
+     */
+    void finish()
+    {
+        for ( int i = 0; i < 5; i++ )
+            shiftLow();
+    }
+
+    /**
+     * Encode a bit with an adaptive probability.
+     * @param model  The probability, updated.
+     * @param bit    The bit.
+     */
+    inline void encodeBit( BitModel *model, int bit )
+    {
+        const unsigned int bound = ( range >> BIT_MODEL_BITS ) * *model;
+
+        if ( bit == 0 )
+        {
+            range = bound;
+            *model += ( ( 1 << BIT_MODEL_BITS ) - *model ) >> BIT_MODEL_SHIFT;
+        }
+        else
+        {
+            low += bound;
+            range -= bound;
+            *model -= *model >> BIT_MODEL_SHIFT;
+        }
+        normalize();
+    }
+
+    /**
+     * Encode bits with probability one half.
+     * @param value  The bits.
+     * @param count  Number of bits (highest first).
+     */
+    inline void encodeDirect( unsigned long long value, int count )
+    {
+        while ( count-- > 0 )
+        {
+            range >>= 1;
+            if ( ( value >> count ) & 1 )
+                low += range;
+            normalize();
+        }
+    }
+
+    /**
+     * Encode an unsigned integer (see IntegerModel).
+     * @param model  The models, updated.
+     * @param value  The integer.
+     */
+    inline void encodeInteger( IntegerModel *model, unsigned long long value )
+    {
+        int length = 0;
+        while ( length < 64 && ( value >> length ) != 0 )
+            length++;
+
+        // Bit tree of 7 bits
+        int node = 1;
+        for ( int i = 6; i >= 0; i-- )
+        {
+            const int bit = ( length >> i ) & 1;
+            encodeBit( &model->length[node], bit );
+            node = ( node << 1 ) | bit;
+        }
+
+        if ( length >= 2 )
+        {
+            encodeBit( &model->second[length], (int) ( ( value >> ( length - 2 ) ) & 1 ) );
+            encodeDirect( value, length - 2 );
+        }
+    }
+};
+
+
+/**
+ * Binary range decoder, the counterpart of RangeEncoder.
+ * Reading past the end gives zeros, so damaged data can't read out of bounds.
+ */
+class RangeDecoder
+{
+private:
+    const unsigned char *in;
+    const unsigned char *end;
+    unsigned int range;
+    unsigned int code;
+
+    inline unsigned char next()
+    {
+        return ( in < end ) ? *in++ : 0;
+    }
+
+    inline void normalize()
+    {
+        while ( range < ( 1u << 24 ) )
+        {
+            range <<= 8;
+            code = ( code << 8 ) | next();
+        }
+    }
+
+public:
+    /**
+     * Start decoding.
+     * @param in    The bytes written by RangeEncoder.
+     * @param size  Number of bytes.
+     */
+    void start( const unsigned char *in, size_t size )
+    {
+        this->in = in;
+        this->end = in + size;
+        this->range = 0xFFFFFFFFu;
+        this->code = 0;
+
+        for ( int i = 0; i < 5; i++ )
+            code = ( code << 8 ) | next();
+    }
+
+    inline int decodeBit( BitModel *model )
+    {
+        const unsigned int bound = ( range >> BIT_MODEL_BITS ) * *model;
+        int bit;
+
+        if ( code < bound )
+        {
+            range = bound;
+            *model += ( ( 1 << BIT_MODEL_BITS ) - *model ) >> BIT_MODEL_SHIFT;
+            bit = 0;
+        }
+        else
+        {
+            code -= bound;
+            range -= bound;
+            *model -= *model >> BIT_MODEL_SHIFT;
+            bit = 1;
+        }
+        normalize();
+        return bit;
+    }
+
+    inline unsigned long long decodeDirect( int count )
+    {
+        unsigned long long value = 0;
+
+        while ( count-- > 0 )
+        {
+            range >>= 1;
+            int bit = 0;
+            if ( code >= range )
+            {
+                code -= range;
+                bit = 1;
+            }
+            value = ( value << 1 ) | bit;
+            normalize();
+        }
+        return value;
+    }
+
+    inline unsigned long long decodeInteger( IntegerModel *model )
+    {
+        int node = 1;
+        for ( int i = 0; i < 7; i++ )
+            node = ( node << 1 ) | decodeBit( &model->length[node] );
+
+        // Damaged data: lengths above 64 don't exist.
+        const int length = ( node - 128 < 64 ) ? node - 128 : 64;
+
+        if ( length == 0 )
+            return 0;
+        if ( length == 1 )
+            return 1;
+
+        unsigned long long value = 2 | decodeBit( &model->second[length] );
+        return ( value << ( length - 2 ) ) | decodeDirect( length - 2 );
+    }
+};
@@ -18,6 +18,9 @@
 
 #include "Particles/ParticleArray.h"
 #include "Particles/Particle.h"
+#include "FloatFormat.h"
+
+#include <string.h>
 
 
 // Constructor / Destructor
@@ -40,36 +43,116 @@ TextInOut::TextInOut( const ScrubberParam &param ) :
 
 TextInOut::~TextInOut()
 {
+    finishWriting();
+
     if ( outputinfo != OUTPUT_NOTHING )
         fclose(f);
 }
 
 
 // Private Methods
-inline void TextInOut::writePositions( bool first_call, double time, const ParticleArray &particles )
+int TextInOut::formatId( uint64 id, char *buffer )
 {
-    if ( first_call )
-        fprintf( f, "#T      X      Y      C\n" );
+    // The digits backwards, then in order.
+    char digits[20];
+    int n = 0;
+
+    do
+    {
+        digits[n++] = (char) ( '0' + id % 10 );
+        id /= 10;
+    }
+    while ( id != 0 );
+
+    for ( int i = 0; i < n; i++ )
+        buffer[i] = digits[n - 1 - i];
+
+    return n;
+}
+
 
-    for ( int i = 0; i < particles.getLength(); i++ )
+// Public Methods
+void TextInOut::writeFrame( const OutputFrame &frame )
+{
+    // Separator between the columns
+    static const char SEPARATOR[] = "     ";
+    const int sep_length = sizeof(SEPARATOR) - 1;
+
+    // Longest line: four numbers, the id (at most 20 digits), four separators and the newline.
+    const size_t max_line = 4 * FORMAT_DOUBLE_MAX + 20 + 4 * sep_length + 1;
+
+    if ( frame.first )
+        fprintf( f, write_ids ? "#T      X      Y      C      I\n" : "#T      X      Y      C\n" );
+
+    // The time is the same on every line.
+    char time_text[FORMAT_DOUBLE_MAX + 1];
+    const int time_length = formatDouble( frame.time, time_text );
+
+    // Every block of particles is formatted into its own buffer, by whichever of the
+    // FORMAT_THREADS gets it; the buffers are written in order afterwards.
+    const int n_blocks = ( frame.length + FORMAT_BLOCK - 1 ) / FORMAT_BLOCK;
+
+    if ( (int) block_text.size() < n_blocks )
+    {
+        block_text.resize( n_blocks );
+        block_length.resize( n_blocks );
+    }
+
+#pragma omp parallel for schedule(dynamic) num_threads(FORMAT_THREADS)
+    for ( int b = 0; b < n_blocks; b++ )
+    {
+        const int begin = b * FORMAT_BLOCK;
+        const int end = min( begin + FORMAT_BLOCK, frame.length );
+
+        std::vector<char> &text = block_text[b];
+        if ( text.size() < max_line * FORMAT_BLOCK + 1 )
+            text.resize( max_line * FORMAT_BLOCK + 1 );
+
+        char *out = &text[0];
+
+        for ( int i = begin; i < end; i++ )
         {
-        // Readability
-        const Vector2d & pos = particles.getParticle( i ).getPos();
-        const double gram = particles.getParticle( i ).getGramCO2();
+            memcpy( out, time_text, time_length );
+            out += time_length;
+
+            memcpy( out, SEPARATOR, sep_length );
+            out += sep_length;
+            out += formatDouble( frame.x[i], out );
+
+            memcpy( out, SEPARATOR, sep_length );
+            out += sep_length;
+            out += formatDouble( frame.y[i], out );
 
-        // Write output to file
-        fprintf( f, "%e     %e     %e     %e\n",
-                 time, pos(0), pos(1), gram );
+            memcpy( out, SEPARATOR, sep_length );
+            out += sep_length;
+            out += formatDouble( frame.gram[i], out );
+
+            if ( write_ids )
+            {
+                memcpy( out, SEPARATOR, sep_length );
+                out += sep_length;
+                out += formatId( frame.id[i], out );
+            }
+
+            *out++ = '\n';
+        }
+
+        block_length[b] = (int) ( out - &text[0] );
     }
+
+    for ( int b = 0; b < n_blocks; b++ )
+        fwrite( &block_text[b][0], 1, block_length[b], f );
+
     fprintf( f, "\n" );
 }
 
-
-// Public Methods
 void TextInOut::writeScalarField( const ScalarField &scalar_field )
 {
-    // Write header
-    fprintf( f, "dx = %e, radius = %e, n = %d\n", dx, radius, n );
+    // Write header (the stretch only on a stretched grid, as the byte format)
+    if ( stretch != 0 )
+        fprintf( f, "dx = %e, radius = %e, n = %d, stretch = %e\n", dx, radius, n, stretch );
+    else
+        fprintf( f, "dx = %e, radius = %e, n = %d\n", dx, radius, n );
 
     // Write the scalar values to file.
     for ( int i = 0; i < scalar_field.shape()(0); i++ )
@@ -85,8 +168,10 @@ void TextInOut::readProfile( ScrubberParam *param, ScalarField *u )
     // Shut up warnings
     int nread;
 
-    // Read the channel header
-    nread = fscanf( f, "dx = %lf, radius = %lf, n = %d\n", &param->channel.dx, &param->channel.radius, &param->channel.n );
+    // Read the channel header, without a stretch the grid is uniform.
+    param->channel.stretch = 0;
+    nread = fscanf( f, "dx = %lf, radius = %lf, n = %d, stretch = %lf\n", &param->channel.dx, &param->channel.radius,
+                    &param->channel.n, &param->channel.stretch );
 
     u->resize( param->channel.n + 2 );
 
@@ -15,6 +15,7 @@
 #pragma once
 
 // Headers
+#include <vector>
 #include "InOut.h"
 
 #include "Scrubber.h"
@@ -23,11 +24,29 @@
 
 /**
  * Writes to the output in humanly readable text form, and reads input from an identically formatted text file.
+ * The particles are written with the shortest digits that read back as the same
+ * doubles (see formatDouble()), formatted in parallel blocks.
  */
 class TextInOut : public InOut
 {
 protected:
-    virtual void writePositions( bool first_call, double time, const ParticleArray &particles );
+    /// Number of particles per block that is formatted by one thread.
+    static const int FORMAT_BLOCK = 4096;
+
+    /// Threads that format a frame. The writer thread runs next to the mover, which
+    /// already uses every core, so it only takes one helper.
+    static const int FORMAT_THREADS = 2;
+
+    std::vector< std::vector<char> > block_text;  /// The formatted blocks of a frame (writer thread only).
+    std::vector<int> block_length;                /// Length of the text in every block.
+
+    /**
+     * Writes an id in decimal (without sprintf, as formatDouble()).
+     * @param id      The id.
+     * @param buffer  Output, at least 20 characters (not zero-terminated).
+     * @return        Number of characters written.
+     */
+    static int formatId( uint64 id, char *buffer );
 
 public:
     /**
@@ -45,4 +64,6 @@ public:
     virtual void writeScalarField( const ScalarField &scalar_field );
 
     virtual void readProfile( ScrubberParam *param, ScalarField *u );
+
+    virtual void writeFrame( const OutputFrame &frame );
 };
@@ -0,0 +1,307 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+// Headers
+#include "TrajectoryReader.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+// Constructor / Destructor
+TrajectoryReader::TrajectoryReader()
+{
+    this->data = NULL;
+    this->size = 0;
+    this->version = 0;
+    this->index = NULL;
+    this->n_frames = 0;
+}
+
+TrajectoryReader::~TrajectoryReader()
+{
+    close();
+}
+
+
+// Private Methods
+bool TrajectoryReader::fitsAddressSpace( const std::string &path )
+{
+    // The whole file is mapped at once, so its size must fit in a size_t.
+    if ( (unsigned long long) size > (unsigned long long) (size_t) -1 )
+    {
+        error = path + " is too large to be mapped by a 32 bit build, use a 64 bit build.";
+        return false;
+    }
+    return true;
+}
+
+void TrajectoryReader::mapFailed( const std::string &path )
+{
+    // A 32 bit process rarely has a free range of more than about a gigabyte.
+    if ( sizeof(void *) < 8 )
+        error = "Could not map " + path + " into memory, a 32 bit build can only map files"
+                " up to about a gigabyte; use a 64 bit build.";
+    else
+        error = "Could not map " + path + " into memory.";
+}
+
+#ifdef _WIN32
+
+bool TrajectoryReader::map( const std::string &path )
+{
+    file = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL, NULL );
+    if ( file == INVALID_HANDLE_VALUE )
+    {
+        error = "Could not open " + path + ".";
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    if ( !GetFileSizeEx( file, &file_size ) || file_size.QuadPart == 0 )
+    {
+        error = path + " is empty.";
+        CloseHandle( file );
+        return false;
+    }
+    size = file_size.QuadPart;
+
+    if ( !fitsAddressSpace( path ) )
+    {
+        CloseHandle( file );
+        return false;
+    }
+
+    mapping = CreateFileMapping( file, NULL, PAGE_READONLY, 0, 0, NULL );
+    if ( mapping == NULL )
+    {
+        mapFailed( path );
+        CloseHandle( file );
+        return false;
+    }
+
+    data = (const char *) MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+    if ( data == NULL )
+    {
+        mapFailed( path );
+        CloseHandle( mapping );
+        CloseHandle( file );
+        return false;
+    }
+    return true;
+}
+
+void TrajectoryReader::unmap()
+{
+    UnmapViewOfFile( data );
+    CloseHandle( mapping );
+    CloseHandle( file );
+}
+
+#else
+
+bool TrajectoryReader::map( const std::string &path )
+{
+    fd = ::open( path.c_str(), O_RDONLY );
+    if ( fd < 0 )
+    {
+        error = "Could not open " + path + ".";
+        return false;
+    }
+
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 || st.st_size == 0 )
+    {
+        error = path + " is empty.";
+        ::close( fd );
+        return false;
+    }
+    size = st.st_size;
+
+    if ( !fitsAddressSpace( path ) )
+    {
+        ::close( fd );
+        return false;
+    }
+
+    void *p = mmap( NULL, (size_t) size, PROT_READ, MAP_SHARED, fd, 0 );
+    if ( p == MAP_FAILED )
+    {
+        mapFailed( path );
+        ::close( fd );
+        return false;
+    }
+
+    data = (const char *) p;
+    return true;
+}
+
+void TrajectoryReader::unmap()
+{
+    munmap( (void *) data, (size_t) size );
+    ::close( fd );
+}
+
+#endif
+
+void TrajectoryReader::walkFrames()
+{
+    walked.clear();
+
+    long long offset = sizeof(TrajectoryHeader);
+
+    while ( offset + (long long) sizeof(TrajectoryFrameHeader) <= size )
+    {
+        const TrajectoryFrameHeader *frame_header = (const TrajectoryFrameHeader *) ( data + offset );
+
+        if ( frame_header->length < 0 )
+            break;
+
+        const long long frame_size = trajectoryFrameSize( frame_header->length, version );
+
+        // The last frame may have been cut off.
+        if ( offset + frame_size > size )
+            break;
+
+        TrajectoryIndexEntry entry = { frame_header->time, frame_header->length, offset };
+        walked.push_back( entry );
+
+        offset += frame_size;
+    }
+
+    index = walked.empty() ? NULL : &walked[0];
+    n_frames = walked.size();
+}
+
+
+// Public Methods
+bool TrajectoryReader::open( const std::string &path )
+{
+    close();
+    error.clear();
+
+    if ( !map( path ) )
+        return false;
+
+    const TrajectoryHeader *header = (const TrajectoryHeader *) data;
+
+    if ( size < (long long) sizeof(TrajectoryHeader)
+         || header->format != TRAJECTORY_FORMAT
+         || header->version < 1 || header->version > TRAJECTORY_VERSION )
+    {
+        close();
+        error = path + " is not an indexed trajectory file of a known version.";
+        return false;
+    }
+
+    version = header->version;
+
+    // Use the index when it is there (and complete), otherwise walk the frames.
+    if ( header->index_offset >= (long long) sizeof(TrajectoryHeader)
+         && header->n_frames >= 0
+         && header->index_offset + header->n_frames * (long long) sizeof(TrajectoryIndexEntry) <= size )
+    {
+        index = (const TrajectoryIndexEntry *) ( data + header->index_offset );
+        n_frames = header->n_frames;
+    }
+    else
+        walkFrames();
+
+    return true;
+}
+
+void TrajectoryReader::close()
+{
+    if ( data != NULL )
+        unmap();
+
+    data = NULL;
+    size = 0;
+    index = NULL;
+    n_frames = 0;
+    walked.clear();
+}
+
+const std::string &TrajectoryReader::getError() const
+{
+    return error;
+}
+
+long long TrajectoryReader::getFrameCount() const
+{
+    return n_frames;
+}
+
+double TrajectoryReader::getRadius() const
+{
+    return ( (const TrajectoryHeader *) data )->radius;
+}
+
+double TrajectoryReader::getHeight() const
+{
+    return ( (const TrajectoryHeader *) data )->height;
+}
+
+TrajectoryFrame TrajectoryReader::frame( long long k ) const
+{
+    const TrajectoryIndexEntry &entry = index[k];
+    const long long column_size = trajectoryColumnSize( entry.length );
+
+    const char *columns = data + entry.offset + sizeof(TrajectoryFrameHeader);
+
+    TrajectoryFrame frame;
+    frame.time = entry.time;
+    frame.length = entry.length;
+    frame.x = (const double *) columns;
+    frame.y = (const double *) ( columns + column_size );
+    frame.gram = (const double *) ( columns + 2 * column_size );
+    frame.id = ( version >= 2 ) ? (const unsigned long long *) ( columns + 3 * column_size ) : NULL;
+
+    return frame;
+}
+
+std::vector<TrajectoryFrame> TrajectoryReader::range( double t0, double t1 ) const
+{
+    // The frames are in order of time: find the first one at or after t0.
+    long long lo = 0;
+    long long hi = n_frames;
+
+    while ( lo < hi )
+    {
+        const long long mid = lo + ( hi - lo ) / 2;
+
+        if ( index[mid].time < t0 )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    std::vector<TrajectoryFrame> frames;
+
+    for ( long long k = lo; k < n_frames && index[k].time <= t1; k++ )
+        frames.push_back( frame( k ) );
+
+    return frames;
+}
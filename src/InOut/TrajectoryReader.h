@@ -0,0 +1,235 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+// Headers
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+
+// Indexed trajectory files (--oformat 3)
+//
+// All numbers are in the byte order of the machine that wrote the file.
+//
+//   TrajectoryHeader                    64 bytes, at offset 0.
+//   Frames                              Every frame starts at a multiple of 64 bytes:
+//     TrajectoryFrameHeader             64 bytes.
+//     x[length], padding                The columns, each padded to a multiple of 64
+//     y[length], padding                bytes, so they are aligned when the file is
+//     gram_co2[length], padding         mapped into memory.
+//     id[length], padding               Unsigned 64 bit ids (from version 2 on).
+//   TrajectoryIndexEntry[n_frames]      At index_offset, written when the file is closed.
+//
+// A file of a run that did not finish has no index (index_offset is 0); the reader
+// then finds the frames by walking the frame headers.
+
+/// File type, the first four bytes of every output file (INOUT_INDEXED).
+const int TRAJECTORY_FORMAT = 3;
+
+/// Version of the layout (1: without ids).
+const int TRAJECTORY_VERSION = 2;
+
+/// Alignment (in bytes) of the frames and columns.
+const int TRAJECTORY_ALIGNMENT = 64;
+
+struct TrajectoryHeader
+{
+    int format;              /// TRAJECTORY_FORMAT.
+    int version;             /// TRAJECTORY_VERSION.
+    double radius;           /// Radius of the channel.
+    double height;           /// Height of the channel.
+    long long n_frames;      /// Number of frames in the index.
+    long long index_offset;  /// Offset of the index, 0 if there is none.
+    char padding[24];
+};
+
+struct TrajectoryFrameHeader
+{
+    double time;      /// Absolute time in seconds.
+    long long length; /// Number of particles.
+    char padding[48];
+};
+
+struct TrajectoryIndexEntry
+{
+    double time;      /// Absolute time in seconds.
+    long long length; /// Number of particles.
+    long long offset; /// Offset of the TrajectoryFrameHeader.
+};
+
+/**
+ * Size of a column of length doubles, padding included.
+ * @param length  Number of particles.
+ * @return        Size in bytes.
+ */
+inline long long trajectoryColumnSize( long long length )
+{
+    const long long size = length * (long long) sizeof(double);
+    return ( size + TRAJECTORY_ALIGNMENT - 1 ) / TRAJECTORY_ALIGNMENT * TRAJECTORY_ALIGNMENT;
+}
+
+
+/**
+ * Size of a frame, its header included.
+ * @param length   Number of particles.
+ * @param version  Version of the layout.
+ * @return         Size in bytes.
+ */
+inline long long trajectoryFrameSize( long long length, int version )
+{
+    const int columns = ( version >= 2 ) ? 4 : 3;
+
+    return sizeof(TrajectoryFrameHeader) + columns * trajectoryColumnSize( length );
+}
+
+
+/**
+ * One frame of a trajectory file; the columns point into the mapped file.
+ */
+struct TrajectoryFrame
+{
+    double time;                   /// Absolute time in seconds.
+    long long length;              /// Number of particles.
+    const double *x;               /// x-coordinate of every particle.
+    const double *y;               /// y-coordinate of every particle.
+    const double *gram;            /// Amount of CO2 of every particle.
+    const unsigned long long *id;  /// Id of every particle (NULL in files of version 1).
+};
+
+
+/**
+ * Reads indexed trajectory files by mapping them into memory.
+ * Nothing is read until it is used, so any frame can be reached without going
+ * through the frames before it. Does not depend on the rest of Scrubber, so
+ * post-processing tools can link it on its own (make libtrajectory.a).
+ */
+class TrajectoryReader
+{
+private:
+    const char *data;  /// The mapped file (NULL if none is open).
+    long long size;    /// Size of the file.
+
+#ifdef _WIN32
+    void *file;
+    void *mapping;
+#else
+    int fd;
+#endif
+
+    int version;                               /// Version of the layout of the file.
+    const TrajectoryIndexEntry *index;         /// Index of the frames.
+    long long n_frames;                        /// Number of frames.
+    std::vector<TrajectoryIndexEntry> walked;  /// The index of a file without one.
+
+    std::string error;  /// Why the last open() failed.
+
+    // Not copyable, the mapping is owned by the reader.
+    TrajectoryReader( const TrajectoryReader & );
+    TrajectoryReader &operator=( const TrajectoryReader & );
+
+    /**
+     * Maps the file into memory.
+     * @param path  Path to the file.
+     * @return      False if it could not be opened or mapped.
+     */
+    bool map( const std::string &path );
+
+    /**
+     * Checks that the whole file can be mapped at once (size_t is 32 bits in a 32 bit build).
+     * @param path  Path to the file, for the error.
+     * @return      False (and sets the error) if it can't.
+     */
+    bool fitsAddressSpace( const std::string &path );
+
+    /**
+     * Sets the error of a failed mapping.
+     * @param path  Path to the file.
+     */
+    void mapFailed( const std::string &path );
+
+    /**
+     * Unmaps and closes the file.
+     */
+    void unmap();
+
+    /**
+     * Builds the index by walking the frame headers, up to the last complete frame.
+     */
+    void walkFrames();
+
+public:
+    /**
+     * Constructor.
+     */
+    TrajectoryReader();
+
+    /**
+     * Destructor, closes the file.
+     */
+    ~TrajectoryReader();
+
+    /**
+     * Opens a trajectory file (closing the previous one).
+     * @param path  Path to the file.
+     * @return      False if it could not be opened or is not an indexed trajectory file,
+     *              getError() tells why.
+     */
+    bool open( const std::string &path );
+
+    /**
+     * Get the reason the last open() failed, e.g. a file too large for a 32 bit build.
+     * @return  The message, empty if the file was opened.
+     */
+    const std::string &getError() const;
+
+    /**
+     * Closes the file, the frames handed out are no longer valid.
+     */
+    void close();
+
+    /**
+     * Get the number of frames.
+     * @return  The number of frames.
+     */
+    long long getFrameCount() const;
+
+    /**
+     * Get the radius of the channel.
+     * @return  The radius of the channel.
+     */
+    double getRadius() const;
+
+    /**
+     * Get the height of the channel.
+     * @return  The height of the channel.
+     */
+    double getHeight() const;
+
+    /**
+     * Get frame k.
+     * @param k  Number of the frame, 0 <= k < getFrameCount().
+     * @return   The frame.
+     */
+    TrajectoryFrame frame( long long k ) const;
+
+    /**
+     * Get the frames with t0 <= time <= t1, by a binary search of the index.
+     * @param t0  Begin of the time range.
+     * @param t1  End of the time range.
+     * @return    The frames, in order.
+     */
+    std::vector<TrajectoryFrame> range( double t0, double t1 ) const;
+};
@@ -0,0 +1,304 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+// Headers
+#include "AdaptiveMover.h"
+
+#include "ParticleArray.h"
+#include "MoveKernel.h"
+
+#include "Channel/Channel.h"
+
+#include "Random/Random.h"
+
+#include <algorithm>
+
+
+// Constructor / Destructor
+template <TurbModel turb, BounceModel bounce>
+AdaptiveMover<turb, bounce>::AdaptiveMover( const ScrubberParam &param, Channel *channel )
+    : Mover( param, channel )
+{
+    this->tol_pos = param.tol * param.channel.dx;
+    this->tol_gram = param.tol * kp.gram_sat;
+    this->min_step = dt / MIN_STEP_DIVISOR;
+}
+
+
+// Private Methods
+template <TurbModel turb, BounceModel bounce>
+Vector2d AdaptiveMover<turb, bounce>::fluidVel( const Vector2d &pos, const Vector2d &vel, const Vector2d &v_vel )
+{
+    if ( turb != TURB_NONE )
+        return v_vel;
+
+    // The Euler predictor can land past the wall; look the profile up at the wall then,
+    // as the velocity tables are only defined inside the channel.
+    Vector2d lookup = pos;
+    lookup(0) = std::min( std::max( pos(0), -radius ), radius );
+
+    Vector2d mean_vel;
+    channel->velocityAt<TURB_NONE>( lookup, vel, &mean_vel, NULL, NULL );
+    return mean_vel;
+}
+
+template <TurbModel turb, BounceModel bounce>
+double AdaptiveMover<turb, bounce>::heunStep( double h, Vector2d *pos, Vector2d *vel, double *gram_co2,
+                                              const Vector2d &v_vel )
+{
+    const Vector2d g_eff( kp.g_x, kp.g_y );
+
+    // The mass transfer constants of the kernels are for a step of dt.
+    MoveKernelParam kp_h = kp;
+    kp_h.dm_factor = kp.dm_factor * (h / dt);
+
+    // Readability
+    const Vector2d x0 = *pos;
+    const Vector2d v0 = *vel;
+    const double m0 = *gram_co2;
+
+    // Euler
+    const Vector2d a0 = kp.inv_tau_a * (fluidVel( x0, v0, v_vel ) - v0) + g_eff;
+    const double k0 = kernelGramCO2<INTEGRATOR_EULER>( kp_h, m0, x0(1), v0(0), v0(1) ) - m0;
+
+    const Vector2d x1 = x0 + v0 * h;
+    const Vector2d v1 = v0 + a0 * h;
+    const double m1 = m0 + k0;
+
+    // Heun: average with the slopes at the end of the Euler step.
+    const Vector2d a1 = kp.inv_tau_a * (fluidVel( x1, v1, v_vel ) - v1) + g_eff;
+    const double k1 = kernelGramCO2<INTEGRATOR_EULER>( kp_h, m1, x1(1), v1(0), v1(1) ) - m1;
+
+    *pos = x0 + (v0 + v1) * (0.5 * h);
+    *vel = v0 + (a0 + a1) * (0.5 * h);
+    *gram_co2 = m0 + 0.5 * (k0 + k1);
+
+    // The difference between Euler and Heun; a velocity error counts by how far it moves the particle.
+    const double err_pos = blitz::norm( *pos - x1 ) + h * blitz::norm( *vel - v1 );
+    const double err_gram = abs( *gram_co2 - m1 );
+
+    return std::max( err_pos / tol_pos, err_gram / tol_gram );
+}
+
+
+// Public Methods
+template <TurbModel turb, BounceModel bounce>
+ColumnMask AdaptiveMover<turb, bounce>::getColumns() const
+{
+    ColumnMask mask = PC_ALL_COLUMNS;
+
+    // Without turbulence the surrounding velocity is the mean velocity, it is not kept.
+    if ( turb == TURB_NONE )
+        mask &= ~( columnBit( PC_V_VEL_X ) | columnBit( PC_V_VEL_Y ) );
+
+    // Only the discrete eddies have a lifetime.
+    if ( turb != TURB_DISCRETE_EDDY )
+        mask &= ~columnBit( PC_COUNT_DOWN );
+
+    return mask;
+}
+
+template <TurbModel turb, BounceModel bounce>
+void AdaptiveMover<turb, bounce>::doMove( ParticleArray *particles, StatsStruct *stats )
+{
+    const int length = particles->getLength();
+
+    if ( (int) pos_box.size() < length )
+        pos_box.resize( particles->getMaxLength() );
+
+    const int n_blocks = (length + KERNEL_BLOCK - 1) / KERNEL_BLOCK;
+
+    // Every block keeps its own statistics, so no thread has to wait for another.
+    block_stats.assign( n_blocks, StatsStruct() );
+
+#pragma omp parallel for
+    for ( int b = 0; b < n_blocks; b++ )
+    {
+        const int begin = b * KERNEL_BLOCK;
+        const int end = std::min( begin + KERNEL_BLOCK, length );
+
+        StatsStruct &partial = block_stats[b];
+
+        for ( int p = begin; p < end; p++ )
+        {
+            // One generator for all the eddies of this particle in this step.
+            Random random( seed, particles->getId( p ), step );
+
+            Vector2d pos = particles->getPos( p );
+            Vector2d vel = particles->getVel( p );
+            Vector2d v_vel( 0, 0 );
+            double count_down = 0;
+            double gram_co2 = particles->getGramCO2( p );
+
+            if ( turb != TURB_NONE )
+                v_vel = particles->getSurroundingVel( p );
+
+            if ( turb == TURB_DISCRETE_EDDY )
+                count_down = particles->getCountDown( p );
+
+            // The correlation of the Langevin model is over dt, so it samples once per step.
+            if ( turb == TURB_LANGEVIN )
+                channel->velocityAt<TURB_LANGEVIN>( pos, vel, &v_vel, &count_down, &random );
+
+            // Sub-step size of the last step (none yet for a new particle).
+            double h = particles->getStep( p );
+            if ( !( h > 0 ) )
+                h = dt;
+
+            PosBox box = P_INSIDE;
+            bool bounced = false;
+            double t = 0;
+
+            while ( t < dt )
+            {
+                // The eddy expired: interact with a new one (not shorter than a sub-step).
+                if ( turb == TURB_DISCRETE_EDDY && count_down <= 0 )
+                {
+                    channel->velocityAt<TURB_DISCRETE_EDDY>( pos, vel, &v_vel, &count_down, &random );
+
+                    if ( !( count_down >= min_step ) )
+                        count_down = min_step;
+                }
+
+                // The sub-step ends at the end of the step, or where the eddy expires.
+                double h_max = dt - t;
+                if ( turb == TURB_DISCRETE_EDDY )
+                    h_max = std::min( h_max, count_down );
+
+                const double h_step = std::min( h, h_max );
+
+                Vector2d new_pos = pos;
+                Vector2d new_vel = vel;
+                double new_gram = gram_co2;
+
+                const double err = heunStep( h_step, &new_pos, &new_vel, &new_gram, v_vel );
+                box = channel->outsideBox( new_pos );
+
+                // Redo a sub-step that is too inaccurate, or that goes through the wall
+                // (so the wall is hit with a short sub-step).
+                if ( h_step > min_step && ( err > 1 || box == P_OUTSIDE_SIDE ) )
+                {
+                    partial.steps_rejected++;
+
+                    const double shrink = ( err > 1 ) ? std::max( 0.2, 0.9 / sqrt( err ) ) : 0.5;
+                    h = std::max( h_step * shrink, min_step );
+                    box = P_INSIDE;
+                    continue;
+                }
+
+                partial.steps_accepted++;
+
+                if ( box != P_INSIDE )
+                {
+                    if ( bounce == BOUNCE_SLICOLL && box == P_OUTSIDE_SIDE )
+                    {
+                        bounceWall( pos, &new_pos, &new_vel, h_step );
+
+                        // Bounced back out at the other side (or still at the wall): stay put.
+                        if ( channel->outsideBox( new_pos ) != P_INSIDE )
+                            new_pos = pos;
+
+                        box = P_INSIDE;
+                        bounced = true;
+                    }
+                    else
+                        break;
+                }
+
+                pos = new_pos;
+                vel = new_vel;
+                gram_co2 = new_gram;
+
+                t = ( h_step == dt - t ) ? dt : t + h_step;
+                if ( turb == TURB_DISCRETE_EDDY )
+                    count_down -= h_step;
+
+                // Next sub-step from the error estimate (first order, hence the square root).
+                // A sub-step that was cut short says little about the size, so it doesn't shrink h.
+                const double grow = ( err > 0 ) ? std::min( 5.0, std::max( 0.2, 0.9 / sqrt( err ) ) ) : 5.0;
+                double next = h_step * grow;
+
+                if ( h_step < h && grow >= 1 )
+                    next = std::max( next, h );
+
+                h = std::min( std::max( next, min_step ), dt );
+            }
+
+            // As the stepping mover: steps in which the particle bounced, not every contact.
+            if ( bounced )
+                partial.bounces++;
+
+            pos_box[p] = box;
+
+            if ( box == P_INSIDE )
+            {
+                particles->setPos( p, pos );
+                particles->setVel( p, vel );
+                particles->setGramCO2( p, gram_co2 );
+                particles->setStep( p, h );
+
+                if ( turb != TURB_NONE )
+                    particles->setSurroundingVel( p, v_vel );
+
+                if ( turb == TURB_DISCRETE_EDDY )
+                    particles->setCountDown( p, count_down );
+
+                continue;
+            }
+
+            // Get the particles CO2
+            partial.captured_co2 += gram_co2;
+
+            // Update the stats
+            switch ( box ) {
+                case P_OUTSIDE_TOP:
+                    partial.p_top++;
+                    break;
+                case P_OUTSIDE_BOTTOM:
+                    partial.p_bottom++;
+                    break;
+                case P_OUTSIDE_SIDE:
+                    partial.p_wall++;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    // Reduce the statistics in block order (independent of the number of threads).
+    int removed = 0;
+
+    for ( int b = 0; b < n_blocks; b++ )
+    {
+        stats->add( block_stats[b] );
+        removed += block_stats[b].p_top + block_stats[b].p_bottom + block_stats[b].p_wall;
+    }
+
+    // Remove the particles that left the box (P_INSIDE is zero, all others are removed).
+    if ( removed > 0 )
+        particles->compact( &pos_box[0] );
+
+    step++;
+}
+
+
+// All combinations of the models, created in main() for --integrator adaptive.
+template class AdaptiveMover<TURB_NONE, BOUNCE_STICK>;
+template class AdaptiveMover<TURB_NONE, BOUNCE_SLICOLL>;
+template class AdaptiveMover<TURB_DISCRETE_EDDY, BOUNCE_STICK>;
+template class AdaptiveMover<TURB_DISCRETE_EDDY, BOUNCE_SLICOLL>;
+template class AdaptiveMover<TURB_LANGEVIN, BOUNCE_STICK>;
+template class AdaptiveMover<TURB_LANGEVIN, BOUNCE_SLICOLL>;
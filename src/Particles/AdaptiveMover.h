@@ -0,0 +1,74 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+// Headers
+#include "Typedefs.h"
+#include "Scrubber.h"
+#include "Mover.h"
+
+
+/**
+ * Mover with adaptive sub-cycling (--integrator adaptive).
+ * Every particle advances through dt in its own sub-steps. A sub-step is taken with
+ * explicit Euler and Heun; their difference estimates the error, which sets the size
+ * of the next sub-step (kept per particle between the steps). Particles in the core
+ * at their terminal velocity take long sub-steps, particles near the walls (short
+ * eddies, large du/dy, bounces) short ones, so dt need not shrink for all of them.
+ * The sub-steps end where an eddy expires, so short eddies are not stretched to dt;
+ * the Langevin model still samples once per dt.
+ */
+template <TurbModel turb, BounceModel bounce>
+class AdaptiveMover : public Mover {
+private:
+    double tol_pos;   /// Tolerated error in the position of one sub-step.
+    double tol_gram;  /// Tolerated error in the amount of CO2 of one sub-step.
+    double min_step;  /// Shortest sub-step.
+
+    /// Shortest sub-step, as a fraction of dt.
+    static const int MIN_STEP_DIVISOR = 1024;
+
+    /**
+     * Velocity of the fluid around the particle.
+     * @param pos    Position of the particle.
+     * @param vel    Velocity of the particle.
+     * @param v_vel  The sampled surrounding velocity (unused without turbulence).
+     * @return       The mean velocity without turbulence, v_vel otherwise.
+     */
+    Vector2d fluidVel( const Vector2d &pos, const Vector2d &vel, const Vector2d &v_vel );
+
+    /**
+     * Takes one sub-step with Heun, and estimates its error by comparing it with Euler.
+     * @param h         Length of the sub-step.
+     * @param pos       Position of the particle, replaced by the new position.
+     * @param vel       Velocity of the particle, replaced by the new velocity.
+     * @param gram_co2  Amount of CO2 in the particle, replaced by the new amount.
+     * @param v_vel     The sampled surrounding velocity.
+     * @return          The error relative to the tolerance (accept if at most 1).
+     */
+    double heunStep( double h, Vector2d *pos, Vector2d *vel, double *gram_co2, const Vector2d &v_vel );
+
+public:
+    /**
+     * Constructor.
+     * @param param    Struct of parameters.
+     * @param channel  The channel with continuous phase.
+     */
+    AdaptiveMover( const ScrubberParam &param, Channel *channel );
+
+    ColumnMask getColumns() const;
+
+    void doMove( ParticleArray *particles, StatsStruct *stats );
+};
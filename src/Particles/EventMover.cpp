@@ -0,0 +1,289 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+// Headers
+#include "EventMover.h"
+
+#include "ParticleArray.h"
+#include "MoveKernel.h"
+
+#include "Channel/Channel.h"
+
+#include "Random/Random.h"
+
+#include <algorithm>
+
+
+// Constructor / Destructor
+template <BounceModel bounce>
+EventMover<bounce>::EventMover( const ScrubberParam &param, Channel *channel )
+    : Mover( param, channel )
+{
+    // The timestep of the stepping movers.
+    this->min_eddy = param.dtscale * min( param.tau_p, param.tau_m );
+}
+
+
+// Private Methods
+template <BounceModel bounce>
+void EventMover<bounce>::advance( const Vector2d &pos, const Vector2d &vel, const Vector2d &v_vel, double s,
+                                  Vector2d *new_pos, Vector2d *new_vel )
+{
+    // Terminal velocity, and the slip relative to it that decays.
+    const Vector2d vinf = v_vel + Vector2d( kp.g_tau_x, kp.g_tau_y );
+    const Vector2d dv = vel - vinf;
+    const double decay = exp( -s * kp.inv_tau_a );
+
+    *new_vel = vinf + dv * decay;
+    *new_pos = pos + vinf * s + dv * ( tau_a * (1 - decay) );
+}
+
+template <BounceModel bounce>
+bool EventMover<bounce>::findCrossing( const Vector2d &pos, const Vector2d &vel, const Vector2d &v_vel, double h,
+                                       double *t_inside, double *t_out )
+{
+    const Vector2d vinf = v_vel + Vector2d( kp.g_tau_x, kp.g_tau_y );
+    const Vector2d dv = vel - vinf;
+
+    // Times to check, in order: the extrema of the coordinates (where the velocity
+    // vinf + dv * exp(-s / tau_a) is zero) that lie within h, and h itself.
+    double check[3];
+    int n_check = 0;
+
+    for ( int d = 0; d < 2; d++ )
+    {
+        const double ratio = -vinf(d) / dv(d);
+
+        if ( ratio > 0 && ratio < 1 )
+        {
+            const double s = -tau_a * log( ratio );
+            if ( s < h )
+                check[n_check++] = s;
+        }
+    }
+
+    if ( n_check == 2 && check[1] < check[0] )
+        std::swap( check[0], check[1] );
+
+    check[n_check++] = h;
+
+    double lo = 0;
+    Vector2d p, v;
+
+    for ( int c = 0; c < n_check; c++ )
+    {
+        advance( pos, vel, v_vel, check[c], &p, &v );
+
+        if ( channel->outsideBox( p ) == P_INSIDE )
+        {
+            lo = check[c];
+            continue;
+        }
+
+        // Between lo and check[c] the particle crosses exactly once.
+        double hi = check[c];
+
+        for ( int i = 0; i < CROSSING_ITERATIONS; i++ )
+        {
+            const double mid = 0.5 * (lo + hi);
+            if ( mid <= lo || mid >= hi )
+                break;
+
+            advance( pos, vel, v_vel, mid, &p, &v );
+
+            if ( channel->outsideBox( p ) == P_INSIDE )
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+        *t_inside = lo;
+        *t_out = hi;
+        return true;
+    }
+
+    return false;
+}
+
+template <BounceModel bounce>
+double EventMover<bounce>::intervalGramCO2( double gram_co2, const Vector2d &pos, const Vector2d &vel, double s )
+{
+    // The kernel constants are for an interval of dt.
+    MoveKernelParam interval = kp;
+    interval.uptake_factor = kp.uptake_factor * (s / dt);
+
+    return kernelGramCO2<INTEGRATOR_EXP>( interval, gram_co2, pos(1), vel(0), vel(1) );
+}
+
+
+// Public Methods
+template <BounceModel bounce>
+ColumnMask EventMover<bounce>::getColumns() const
+{
+    return PC_ALL_COLUMNS & ~columnBit( PC_STEP );
+}
+
+template <BounceModel bounce>
+void EventMover<bounce>::doMove( ParticleArray *particles, StatsStruct *stats )
+{
+    const int length = particles->getLength();
+
+    if ( (int) pos_box.size() < length )
+        pos_box.resize( particles->getMaxLength() );
+
+    const int n_blocks = (length + KERNEL_BLOCK - 1) / KERNEL_BLOCK;
+
+    // Every block keeps its own statistics, so no thread has to wait for another.
+    block_stats.assign( n_blocks, StatsStruct() );
+
+#pragma omp parallel for
+    for ( int b = 0; b < n_blocks; b++ )
+    {
+        const int begin = b * KERNEL_BLOCK;
+        const int end = min( begin + KERNEL_BLOCK, length );
+
+        StatsStruct &partial = block_stats[b];
+
+        for ( int p = begin; p < end; p++ )
+        {
+            // One generator for all the eddies of this particle in this step.
+            Random random( seed, particles->getId( p ), step );
+
+            Vector2d pos = particles->getPos( p );
+            Vector2d vel = particles->getVel( p );
+            Vector2d v_vel = particles->getSurroundingVel( p );
+            double count_down = particles->getCountDown( p );
+            double gram_co2 = particles->getGramCO2( p );
+
+            PosBox box = P_INSIDE;
+            int bounces = 0;
+            double t = 0;
+
+            // Jump from event to event until the end of the step.
+            while ( t < dt )
+            {
+                // The eddy expired: interact with a new one.
+                if ( count_down <= 0 )
+                {
+                    channel->velocityAt<TURB_DISCRETE_EDDY>( pos, vel, &v_vel, &count_down, &random );
+
+                    // Near the wall the eddies become arbitrarily short, and without
+                    // fluctuations they have no length at all; the stepping movers can't
+                    // sample more than once per their dt either.
+                    if ( !( count_down >= min_eddy ) )
+                        count_down = min_eddy;
+                }
+
+                const double h = min( count_down, dt - t );
+                double t_inside, t_out;
+                Vector2d new_pos, new_vel;
+
+                if ( !findCrossing( pos, vel, v_vel, h, &t_inside, &t_out ) )
+                {
+                    advance( pos, vel, v_vel, h, &new_pos, &new_vel );
+                    gram_co2 = intervalGramCO2( gram_co2, new_pos, new_vel, h );
+
+                    pos = new_pos;
+                    vel = new_vel;
+                    count_down -= h;
+                    t += h;
+                    continue;
+                }
+
+                // Where it left the box (from the same start as the search).
+                advance( pos, vel, v_vel, t_out, &new_pos, &new_vel );
+                box = channel->outsideBox( new_pos );
+
+                // Up to the crossing.
+                advance( pos, vel, v_vel, t_inside, &new_pos, &new_vel );
+                gram_co2 = intervalGramCO2( gram_co2, new_pos, new_vel, t_inside );
+
+                pos = new_pos;
+                vel = new_vel;
+                count_down -= t_inside;
+                t += t_inside;
+
+                if ( bounce == BOUNCE_SLICOLL && box == P_OUTSIDE_SIDE )
+                {
+                    // Sliding collision (see Mover::bounceWall()), then carry on from the wall.
+                    vel = Vector2d( - c_restitution * vel(0),
+                                    vel(1) + c_friction * ( 1 + c_restitution ) * vel(0) );
+                    box = P_INSIDE;
+
+                    if ( ++bounces > MAX_BOUNCES )
+                        break;
+
+                    continue;
+                }
+
+                break;
+            }
+
+            // As the stepping mover: steps in which the particle bounced, not every contact.
+            if ( bounces > 0 )
+                partial.bounces++;
+
+            pos_box[p] = box;
+
+            if ( box == P_INSIDE )
+            {
+                particles->setPos( p, pos );
+                particles->setVel( p, vel );
+                particles->setSurroundingVel( p, v_vel );
+                particles->setCountDown( p, count_down );
+                particles->setGramCO2( p, gram_co2 );
+                continue;
+            }
+
+            // Get the particles CO2
+            partial.captured_co2 += gram_co2;
+
+            // Update the stats
+            switch ( box ) {
+                case P_OUTSIDE_TOP:
+                    partial.p_top++;
+                    break;
+                case P_OUTSIDE_BOTTOM:
+                    partial.p_bottom++;
+                    break;
+                case P_OUTSIDE_SIDE:
+                    partial.p_wall++;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    // Reduce the statistics in block order (independent of the number of threads).
+    int removed = 0;
+
+    for ( int b = 0; b < n_blocks; b++ )
+    {
+        stats->add( block_stats[b] );
+        removed += block_stats[b].p_top + block_stats[b].p_bottom + block_stats[b].p_wall;
+    }
+
+    // Remove the particles that left the box (P_INSIDE is zero, all others are removed).
+    if ( removed > 0 )
+        particles->compact( &pos_box[0] );
+
+    step++;
+}
+
+
+// The bounce models, created in main() for --integrator event.
+template class EventMover<BOUNCE_STICK>;
+template class EventMover<BOUNCE_SLICOLL>;
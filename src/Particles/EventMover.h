@@ -0,0 +1,91 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+// Headers
+#include "Typedefs.h"
+#include "Scrubber.h"
+#include "Mover.h"
+
+
+/**
+ * Event driven mover for the Discrete Eddy Model (--integrator event).
+ * The surrounding velocity of a particle only changes when its eddy expires, and in
+ * between its trajectory is analytic (see kernelMotion()). So instead of taking steps
+ * of dt, every particle jumps from one eddy interaction to the next, or to the moment
+ * it crosses the wall, top or bottom. A step of doMove() only synchronizes the particles
+ * at the next step time (where they are emitted and written), so dt can be as large
+ * as the output interval; the positions in the frames are exact, not interpolated.
+ */
+template <BounceModel bounce>
+class EventMover : public Mover {
+private:
+    double min_eddy;  /// Shortest eddy interaction time.
+
+    /// Bisection steps to locate a crossing (down to the resolution of a double).
+    static const int CROSSING_ITERATIONS = 60;
+
+    /// Most bounces of one particle in a step; a particle pinned against the wall waits.
+    static const int MAX_BOUNCES = 64;
+
+    /**
+     * Position and velocity after time s, for a constant surrounding velocity.
+     * @param pos      Position of the particle.
+     * @param vel      Velocity of the particle.
+     * @param v_vel    Velocity of the surrounding fluid.
+     * @param s        Time to advance.
+     * @param new_pos  The position after time s.
+     * @param new_vel  The velocity after time s.
+     */
+    void advance( const Vector2d &pos, const Vector2d &vel, const Vector2d &v_vel, double s,
+                  Vector2d *new_pos, Vector2d *new_vel );
+
+    /**
+     * Finds the first moment within [0, h] the particle is outside the box.
+     * Every coordinate has at most one extremum, so between the extrema the box is left
+     * at most once, and the crossing can be found by bisection.
+     * @param pos       Position of the particle (inside the box).
+     * @param vel       Velocity of the particle.
+     * @param v_vel     Velocity of the surrounding fluid.
+     * @param h         Length of the interval.
+     * @param t_inside  Last time the particle is inside, just before the crossing.
+     * @param t_out     First time the particle is outside.
+     * @return          True if the particle leaves the box within h.
+     */
+    bool findCrossing( const Vector2d &pos, const Vector2d &vel, const Vector2d &v_vel, double h,
+                       double *t_inside, double *t_out );
+
+    /**
+     * New amount of CO2 after an interval of length s, with the implicit update of the kernels.
+     * @param gram_co2  Current amount of CO2 in the particle.
+     * @param pos       Position at the end of the interval.
+     * @param vel       Velocity at the end of the interval.
+     * @param s         Length of the interval.
+     * @return          The new amount of CO2 in the particle.
+     */
+    double intervalGramCO2( double gram_co2, const Vector2d &pos, const Vector2d &vel, double s );
+
+public:
+    /**
+     * Constructor.
+     * @param param    Struct of parameters.
+     * @param channel  The channel with continuous phase.
+     */
+    EventMover( const ScrubberParam &param, Channel *channel );
+
+    ColumnMask getColumns() const;
+
+    void doMove( ParticleArray *particles, StatsStruct *stats );
+};
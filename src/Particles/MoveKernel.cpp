@@ -0,0 +1,365 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+// Headers
+#include "MoveKernel.h"
+
+#include "ParticleArray.h"
+
+// The vector kernels need per-function target attributes and cpu detection.
+#if ( defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__)) ) && ( defined(__x86_64__) || defined(__i386__) )
+#define SCRUBBER_SIMD_KERNELS
+#include <immintrin.h>
+#endif
+
+
+// Scalar kernel
+static inline int classify( const MoveKernelParam &kp, double x, double y )
+{
+    // Same order of checks as Channel::outsideBox(), without branches.
+    const int side = fabs( x ) >= kp.radius;
+    const int bottom = y <= 0;
+    const int top = y >= kp.height;
+
+    int box = side * P_OUTSIDE_SIDE;
+    box = bottom ? P_OUTSIDE_BOTTOM : box;
+    box = top ? P_OUTSIDE_TOP : box;
+    return box;
+}
+
+template <Integrator integ>
+static void moveKernelScalar( const MoveKernelParam &kp, double * const *columns,
+                              int begin, int end, int *pos_box )
+{
+    double * const pos_x = columns[PC_POS_X];
+    double * const pos_y = columns[PC_POS_Y];
+    double * const vel_x = columns[PC_VEL_X];
+    double * const vel_y = columns[PC_VEL_Y];
+    const double * const v_vel_x = columns[PC_V_VEL_X];
+    const double * const v_vel_y = columns[PC_V_VEL_Y];
+    double * const gram_co2 = columns[PC_GRAM_CO2];
+
+    for ( int p = begin; p < end; p++ )
+    {
+        // Particle equation of motion.
+        double x = pos_x[p], y = pos_y[p];
+        double vx = vel_x[p], vy = vel_y[p];
+        kernelMotion<integ>( kp, &x, &y, &vx, &vy, v_vel_x[p], v_vel_y[p] );
+
+        const int box = classify( kp, x, y );
+        pos_box[p] = box;
+
+        if ( box == P_INSIDE )
+        {
+            pos_x[p] = x;
+            pos_y[p] = y;
+            vel_x[p] = vx;
+            vel_y[p] = vy;
+            gram_co2[p] = kernelGramCO2<integ>( kp, gram_co2[p], y, vx, vy );
+        }
+    }
+}
+
+
+#ifdef SCRUBBER_SIMD_KERNELS
+
+// AVX2 kernel, 4 particles per instruction.
+// Note: no FMA, so the results are identical to those of the scalar kernel.
+template <Integrator integ>
+__attribute__(( target("avx2") ))
+static void moveKernelAVX2( const MoveKernelParam &kp, double * const *columns,
+                            int begin, int end, int *pos_box )
+{
+    double * const pos_x = columns[PC_POS_X];
+    double * const pos_y = columns[PC_POS_Y];
+    double * const vel_x = columns[PC_VEL_X];
+    double * const vel_y = columns[PC_VEL_Y];
+    const double * const v_vel_x = columns[PC_V_VEL_X];
+    const double * const v_vel_y = columns[PC_V_VEL_Y];
+    double * const gram_co2 = columns[PC_GRAM_CO2];
+
+    const __m256d dt = _mm256_set1_pd( kp.dt );
+    const __m256d inv_tau_a = _mm256_set1_pd( kp.inv_tau_a );
+    const __m256d g_x = _mm256_set1_pd( kp.g_x );
+    const __m256d g_y = _mm256_set1_pd( kp.g_y );
+    const __m256d exp_decay = _mm256_set1_pd( kp.exp_decay );
+    const __m256d exp_disp = _mm256_set1_pd( kp.exp_disp );
+    const __m256d g_tau_x = _mm256_set1_pd( kp.g_tau_x );
+    const __m256d g_tau_y = _mm256_set1_pd( kp.g_tau_y );
+    const __m256d height = _mm256_set1_pd( kp.height );
+    const __m256d radius = _mm256_set1_pd( kp.radius );
+    const __m256d mass_frac_b = _mm256_set1_pd( kp.mass_frac_b );
+    const __m256d mass_frac_t = _mm256_set1_pd( kp.mass_frac_t );
+    const __m256d re_factor = _mm256_set1_pd( kp.re_factor );
+    const __m256d sh_factor = _mm256_set1_pd( kp.sh_factor );
+    const __m256d co2_mole_mass = _mm256_set1_pd( kp.co2_mole_mass );
+    const __m256d mole_mea_total = _mm256_set1_pd( kp.mole_mea_total );
+    const __m256d mole_total = _mm256_set1_pd( kp.mole_total );
+    const __m256d dm_factor = _mm256_set1_pd( kp.dm_factor );
+    const __m256d gram_sat = _mm256_set1_pd( kp.gram_sat );
+    const __m256d uptake_factor = _mm256_set1_pd( kp.uptake_factor );
+
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd( 1.0 );
+    const __m256d two = _mm256_set1_pd( 2.0 );
+    const __m256d sign = _mm256_set1_pd( -0.0 );
+    const __m256d box_side = _mm256_set1_pd( P_OUTSIDE_SIDE );
+    const __m256d box_top = _mm256_set1_pd( P_OUTSIDE_TOP );
+    const __m256d box_bottom = _mm256_set1_pd( P_OUTSIDE_BOTTOM );
+
+    int p = begin;
+    for ( ; p + 4 <= end; p += 4 )
+    {
+        const __m256d old_vx = _mm256_load_pd( vel_x + p );
+        const __m256d old_vy = _mm256_load_pd( vel_y + p );
+        const __m256d old_x = _mm256_load_pd( pos_x + p );
+        const __m256d old_y = _mm256_load_pd( pos_y + p );
+        const __m256d old_gram = _mm256_load_pd( gram_co2 + p );
+
+        // Particle equation of motion, see kernelMotion().
+        __m256d vx, vy, x, y;
+
+        if ( integ == INTEGRATOR_EXP )
+        {
+            const __m256d vinf_x = _mm256_add_pd( _mm256_load_pd( v_vel_x + p ), g_tau_x );
+            const __m256d vinf_y = _mm256_add_pd( _mm256_load_pd( v_vel_y + p ), g_tau_y );
+            const __m256d dvx = _mm256_sub_pd( old_vx, vinf_x );
+            const __m256d dvy = _mm256_sub_pd( old_vy, vinf_y );
+            vx = _mm256_add_pd( vinf_x, _mm256_mul_pd( dvx, exp_decay ) );
+            vy = _mm256_add_pd( vinf_y, _mm256_mul_pd( dvy, exp_decay ) );
+            x = _mm256_add_pd( _mm256_add_pd( old_x, _mm256_mul_pd( vinf_x, dt ) ), _mm256_mul_pd( dvx, exp_disp ) );
+            y = _mm256_add_pd( _mm256_add_pd( old_y, _mm256_mul_pd( vinf_y, dt ) ), _mm256_mul_pd( dvy, exp_disp ) );
+        }
+        else
+        {
+            const __m256d ax = _mm256_add_pd( _mm256_mul_pd( inv_tau_a, _mm256_sub_pd( _mm256_load_pd( v_vel_x + p ), old_vx ) ), g_x );
+            const __m256d ay = _mm256_add_pd( _mm256_mul_pd( inv_tau_a, _mm256_sub_pd( _mm256_load_pd( v_vel_y + p ), old_vy ) ), g_y );
+            vx = _mm256_add_pd( old_vx, _mm256_mul_pd( ax, dt ) );
+            vy = _mm256_add_pd( old_vy, _mm256_mul_pd( ay, dt ) );
+            x = _mm256_add_pd( old_x, _mm256_mul_pd( vx, dt ) );
+            y = _mm256_add_pd( old_y, _mm256_mul_pd( vy, dt ) );
+        }
+
+        // Box classification.
+        const __m256d side = _mm256_cmp_pd( _mm256_andnot_pd( sign, x ), radius, _CMP_GE_OQ );
+        const __m256d bottom = _mm256_cmp_pd( y, zero, _CMP_LE_OQ );
+        const __m256d top = _mm256_cmp_pd( y, height, _CMP_GE_OQ );
+        const __m256d outside = _mm256_or_pd( side, _mm256_or_pd( bottom, top ) );
+
+        __m256d box = _mm256_and_pd( side, box_side );
+        box = _mm256_blendv_pd( box, box_bottom, bottom );
+        box = _mm256_blendv_pd( box, box_top, top );
+        _mm_storeu_si128( (__m128i *) (pos_box + p), _mm256_cvttpd_epi32( box ) );
+
+        // Mass transfer.
+        const __m256d correction_factor = _mm256_div_pd(
+                _mm256_sub_pd( mole_mea_total, _mm256_mul_pd( two, _mm256_div_pd( old_gram, co2_mole_mass ) ) ),
+                mole_total );
+        const __m256d speed = _mm256_sqrt_pd( _mm256_add_pd( _mm256_mul_pd( vx, vx ), _mm256_mul_pd( vy, vy ) ) );
+        const __m256d Sh = _mm256_add_pd( two, _mm256_mul_pd( sh_factor, _mm256_sqrt_pd( _mm256_mul_pd( speed, re_factor ) ) ) );
+        const __m256d y_rel = _mm256_div_pd( y, height );
+        const __m256d mass_frac = _mm256_add_pd( _mm256_mul_pd( mass_frac_b, _mm256_sub_pd( one, y_rel ) ),
+                                                 _mm256_mul_pd( mass_frac_t, y_rel ) );
+
+        __m256d dm;
+        if ( integ == INTEGRATOR_EXP )
+        {
+            const __m256d rate = _mm256_mul_pd( _mm256_mul_pd( Sh, uptake_factor ), mass_frac );
+            dm = _mm256_mul_pd( _mm256_div_pd( rate, _mm256_add_pd( one, rate ) ), _mm256_sub_pd( gram_sat, old_gram ) );
+        }
+        else
+            dm = _mm256_mul_pd( _mm256_mul_pd( _mm256_mul_pd( Sh, dm_factor ), mass_frac ), correction_factor );
+
+        const __m256d absorbs = _mm256_cmp_pd( correction_factor, zero, _CMP_GT_OQ );
+        const __m256d gram = _mm256_blendv_pd( old_gram, _mm256_add_pd( old_gram, dm ), absorbs );
+
+        // Only particles that are still inside get their new state.
+        _mm256_store_pd( pos_x + p, _mm256_blendv_pd( x, old_x, outside ) );
+        _mm256_store_pd( pos_y + p, _mm256_blendv_pd( y, old_y, outside ) );
+        _mm256_store_pd( vel_x + p, _mm256_blendv_pd( vx, old_vx, outside ) );
+        _mm256_store_pd( vel_y + p, _mm256_blendv_pd( vy, old_vy, outside ) );
+        _mm256_store_pd( gram_co2 + p, _mm256_blendv_pd( gram, old_gram, outside ) );
+    }
+
+    // Remainder
+    moveKernelScalar<integ>( kp, columns, p, end, pos_box );
+}
+
+// AVX-512 kernel, 8 particles per instruction.
+// AVX-512F implies FMA, so contraction has to be switched off explicitly.
+template <Integrator integ>
+__attribute__(( target("avx512f"), optimize("fp-contract=off") ))
+static void moveKernelAVX512( const MoveKernelParam &kp, double * const *columns,
+                              int begin, int end, int *pos_box )
+{
+    double * const pos_x = columns[PC_POS_X];
+    double * const pos_y = columns[PC_POS_Y];
+    double * const vel_x = columns[PC_VEL_X];
+    double * const vel_y = columns[PC_VEL_Y];
+    const double * const v_vel_x = columns[PC_V_VEL_X];
+    const double * const v_vel_y = columns[PC_V_VEL_Y];
+    double * const gram_co2 = columns[PC_GRAM_CO2];
+
+    const __m512d dt = _mm512_set1_pd( kp.dt );
+    const __m512d inv_tau_a = _mm512_set1_pd( kp.inv_tau_a );
+    const __m512d g_x = _mm512_set1_pd( kp.g_x );
+    const __m512d g_y = _mm512_set1_pd( kp.g_y );
+    const __m512d exp_decay = _mm512_set1_pd( kp.exp_decay );
+    const __m512d exp_disp = _mm512_set1_pd( kp.exp_disp );
+    const __m512d g_tau_x = _mm512_set1_pd( kp.g_tau_x );
+    const __m512d g_tau_y = _mm512_set1_pd( kp.g_tau_y );
+    const __m512d height = _mm512_set1_pd( kp.height );
+    const __m512d radius = _mm512_set1_pd( kp.radius );
+    const __m512d mass_frac_b = _mm512_set1_pd( kp.mass_frac_b );
+    const __m512d mass_frac_t = _mm512_set1_pd( kp.mass_frac_t );
+    const __m512d re_factor = _mm512_set1_pd( kp.re_factor );
+    const __m512d sh_factor = _mm512_set1_pd( kp.sh_factor );
+    const __m512d co2_mole_mass = _mm512_set1_pd( kp.co2_mole_mass );
+    const __m512d mole_mea_total = _mm512_set1_pd( kp.mole_mea_total );
+    const __m512d mole_total = _mm512_set1_pd( kp.mole_total );
+    const __m512d dm_factor = _mm512_set1_pd( kp.dm_factor );
+    const __m512d gram_sat = _mm512_set1_pd( kp.gram_sat );
+    const __m512d uptake_factor = _mm512_set1_pd( kp.uptake_factor );
+
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512d one = _mm512_set1_pd( 1.0 );
+    const __m512d two = _mm512_set1_pd( 2.0 );
+    const __m512d box_side = _mm512_set1_pd( P_OUTSIDE_SIDE );
+    const __m512d box_top = _mm512_set1_pd( P_OUTSIDE_TOP );
+    const __m512d box_bottom = _mm512_set1_pd( P_OUTSIDE_BOTTOM );
+
+    int p = begin;
+    for ( ; p + 8 <= end; p += 8 )
+    {
+        const __m512d old_vx = _mm512_load_pd( vel_x + p );
+        const __m512d old_vy = _mm512_load_pd( vel_y + p );
+        const __m512d old_x = _mm512_load_pd( pos_x + p );
+        const __m512d old_y = _mm512_load_pd( pos_y + p );
+        const __m512d old_gram = _mm512_load_pd( gram_co2 + p );
+
+        // Particle equation of motion, see kernelMotion().
+        __m512d vx, vy, x, y;
+
+        if ( integ == INTEGRATOR_EXP )
+        {
+            const __m512d vinf_x = _mm512_add_pd( _mm512_load_pd( v_vel_x + p ), g_tau_x );
+            const __m512d vinf_y = _mm512_add_pd( _mm512_load_pd( v_vel_y + p ), g_tau_y );
+            const __m512d dvx = _mm512_sub_pd( old_vx, vinf_x );
+            const __m512d dvy = _mm512_sub_pd( old_vy, vinf_y );
+            vx = _mm512_add_pd( vinf_x, _mm512_mul_pd( dvx, exp_decay ) );
+            vy = _mm512_add_pd( vinf_y, _mm512_mul_pd( dvy, exp_decay ) );
+            x = _mm512_add_pd( _mm512_add_pd( old_x, _mm512_mul_pd( vinf_x, dt ) ), _mm512_mul_pd( dvx, exp_disp ) );
+            y = _mm512_add_pd( _mm512_add_pd( old_y, _mm512_mul_pd( vinf_y, dt ) ), _mm512_mul_pd( dvy, exp_disp ) );
+        }
+        else
+        {
+            const __m512d ax = _mm512_add_pd( _mm512_mul_pd( inv_tau_a, _mm512_sub_pd( _mm512_load_pd( v_vel_x + p ), old_vx ) ), g_x );
+            const __m512d ay = _mm512_add_pd( _mm512_mul_pd( inv_tau_a, _mm512_sub_pd( _mm512_load_pd( v_vel_y + p ), old_vy ) ), g_y );
+            vx = _mm512_add_pd( old_vx, _mm512_mul_pd( ax, dt ) );
+            vy = _mm512_add_pd( old_vy, _mm512_mul_pd( ay, dt ) );
+            x = _mm512_add_pd( old_x, _mm512_mul_pd( vx, dt ) );
+            y = _mm512_add_pd( old_y, _mm512_mul_pd( vy, dt ) );
+        }
+
+        // Box classification.
+        const __mmask8 side = _mm512_cmp_pd_mask( _mm512_abs_pd( x ), radius, _CMP_GE_OQ );
+        const __mmask8 bottom = _mm512_cmp_pd_mask( y, zero, _CMP_LE_OQ );
+        const __mmask8 top = _mm512_cmp_pd_mask( y, height, _CMP_GE_OQ );
+        const __mmask8 inside = ~( side | bottom | top );
+
+        __m512d box = _mm512_maskz_mov_pd( side, box_side );
+        box = _mm512_mask_blend_pd( bottom, box, box_bottom );
+        box = _mm512_mask_blend_pd( top, box, box_top );
+        _mm256_storeu_si256( (__m256i *) (pos_box + p), _mm512_cvttpd_epi32( box ) );
+
+        // Mass transfer.
+        const __m512d correction_factor = _mm512_div_pd(
+                _mm512_sub_pd( mole_mea_total, _mm512_mul_pd( two, _mm512_div_pd( old_gram, co2_mole_mass ) ) ),
+                mole_total );
+        const __m512d speed = _mm512_sqrt_pd( _mm512_add_pd( _mm512_mul_pd( vx, vx ), _mm512_mul_pd( vy, vy ) ) );
+        const __m512d Sh = _mm512_add_pd( two, _mm512_mul_pd( sh_factor, _mm512_sqrt_pd( _mm512_mul_pd( speed, re_factor ) ) ) );
+        const __m512d y_rel = _mm512_div_pd( y, height );
+        const __m512d mass_frac = _mm512_add_pd( _mm512_mul_pd( mass_frac_b, _mm512_sub_pd( one, y_rel ) ),
+                                                 _mm512_mul_pd( mass_frac_t, y_rel ) );
+
+        __m512d dm;
+        if ( integ == INTEGRATOR_EXP )
+        {
+            const __m512d rate = _mm512_mul_pd( _mm512_mul_pd( Sh, uptake_factor ), mass_frac );
+            dm = _mm512_mul_pd( _mm512_div_pd( rate, _mm512_add_pd( one, rate ) ), _mm512_sub_pd( gram_sat, old_gram ) );
+        }
+        else
+            dm = _mm512_mul_pd( _mm512_mul_pd( _mm512_mul_pd( Sh, dm_factor ), mass_frac ), correction_factor );
+
+        const __mmask8 absorbs = _mm512_cmp_pd_mask( correction_factor, zero, _CMP_GT_OQ );
+
+        // Only particles that are still inside get their new state.
+        _mm512_mask_store_pd( pos_x + p, inside, x );
+        _mm512_mask_store_pd( pos_y + p, inside, y );
+        _mm512_mask_store_pd( vel_x + p, inside, vx );
+        _mm512_mask_store_pd( vel_y + p, inside, vy );
+        _mm512_mask_store_pd( gram_co2 + p, inside & absorbs, _mm512_add_pd( old_gram, dm ) );
+    }
+
+    // Remainder
+    moveKernelScalar<integ>( kp, columns, p, end, pos_box );
+}
+
+#endif
+
+
+// Public functions
+KernelISA detectKernelISA()
+{
+#ifdef SCRUBBER_SIMD_KERNELS
+    __builtin_cpu_init();
+
+    if ( __builtin_cpu_supports( "avx512f" ) )
+        return KERNEL_AVX512;
+
+    if ( __builtin_cpu_supports( "avx2" ) )
+        return KERNEL_AVX2;
+#endif
+
+    return KERNEL_SCALAR;
+}
+
+MoveKernelFunc getMoveKernel( KernelISA isa, Integrator integrator )
+{
+    const bool use_exp = ( integrator == INTEGRATOR_EXP );
+
+    switch ( isa ) {
+#ifdef SCRUBBER_SIMD_KERNELS
+        case KERNEL_AVX512:
+            return use_exp ? moveKernelAVX512<INTEGRATOR_EXP> : moveKernelAVX512<INTEGRATOR_EULER>;
+        case KERNEL_AVX2:
+            return use_exp ? moveKernelAVX2<INTEGRATOR_EXP> : moveKernelAVX2<INTEGRATOR_EULER>;
+#endif
+        default:
+            return use_exp ? moveKernelScalar<INTEGRATOR_EXP> : moveKernelScalar<INTEGRATOR_EULER>;
+    }
+}
+
+const char *kernelISAName( KernelISA isa )
+{
+    switch ( isa ) {
+        case KERNEL_AVX512:
+            return "AVX-512";
+        case KERNEL_AVX2:
+            return "AVX2";
+        default:
+            return "scalar";
+    }
+}
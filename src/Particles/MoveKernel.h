@@ -0,0 +1,174 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+// Headers
+#include <math.h>
+
+#include "Typedefs.h"
+#include "Scrubber.h"
+
+
+// Enums
+enum KernelISA
+{
+    KERNEL_SCALAR,
+    KERNEL_AVX2,
+    KERNEL_AVX512
+};
+
+
+/**
+ * Constants used by the particle integration kernels.
+ * Everything that does not change during a run is folded in here once.
+ */
+struct MoveKernelParam
+{
+    double dt;         /// Stepsize of the time.
+    double inv_tau_a;  /// 1 / tau_a.
+    double g_x, g_y;   /// Gravity corrected for buoyancy and added mass.
+
+    // Exponential integrator (INTEGRATOR_EXP)
+    double exp_decay;      /// exp( -dt / tau_a ), decay of the slip velocity in one step.
+    double exp_disp;       /// tau_a * (1 - exp_decay), displacement by the slip velocity in one step.
+    double g_tau_x, g_tau_y; /// Gravity times tau_a, the terminal slip velocity.
+
+    double height;     /// Height of the channel.
+    double radius;     /// Radius of the channel.
+
+    double mass_frac_b;  /// Mass fraction of CO2 at the bottom.
+    double mass_frac_t;  /// Mass fraction of CO2 at the top.
+
+    double re_factor;      /// pdiameter / nu, multiplied by the speed gives Re_p.
+    double sh_factor;      /// 0.66 * Sc^(1/3).
+    double co2_mole_mass;  /// Molecular mass of CO2.
+    double mole_mea_total; /// Total amount of mole MEA in a particle.
+    double mole_total;     /// Total amount of mole MEA and solvent in a particle.
+    double dm_factor;      /// PI * pdiameter * co2_density * co2_diffusivity * dt * 1000.
+    double gram_sat;       /// Amount of CO2 at which all MEA is used (correction factor zero).
+    double uptake_factor;  /// 2 * dm_factor / (co2_mole_mass * mole_total), times Sh and the mass fraction gives dt / tau_m.
+};
+
+
+/**
+ * Signature of the integration kernels.
+ * Advances particles [begin, end) with the equation of motion, classifies their new
+ * position with respect to the box, and for the particles that are still inside writes
+ * back the new position, velocity and amount of CO2. Particles that left the box are
+ * left untouched, so they can be bounced or removed afterwards.
+ * @param kp       The kernel constants.
+ * @param columns  The columns of the ParticleArray.
+ * @param begin    First particle; must be a multiple of MOVE_KERNEL_ALIGN.
+ * @param end      One past the last particle.
+ * @param pos_box  Receives the PosBox of every particle in [begin, end).
+ */
+typedef void (*MoveKernelFunc)( const MoveKernelParam &kp, double * const *columns,
+                                int begin, int end, int *pos_box );
+
+/// The begin of a kernel range has to be a multiple of this, to keep the vector loads aligned.
+const int MOVE_KERNEL_ALIGN = 8;
+
+/**
+ * Detects the widest instruction set the cpu (and OS) supports.
+ * @return  The instruction set to use.
+ */
+KernelISA detectKernelISA();
+
+/**
+ * Get the kernel for an instruction set and integrator.
+ * @param isa         The instruction set.
+ * @param integrator  The integrator.
+ * @return            The kernel.
+ */
+MoveKernelFunc getMoveKernel( KernelISA isa, Integrator integrator );
+
+/**
+ * Readable name of an instruction set.
+ * @param isa  The instruction set.
+ * @return     Its name.
+ */
+const char *kernelISAName( KernelISA isa );
+
+/**
+ * Advances the velocity and position of one particle; the scalar reference of the kernels.
+ * INTEGRATOR_EULER is explicit Euler. INTEGRATOR_EXP is the exact solution for a fluid
+ * velocity that is constant during the step: the slip velocity decays exponentially.
+ * @param kp      The kernel constants.
+ * @param x, y    Position of the particle, replaced by the new position.
+ * @param vx, vy  Velocity of the particle, replaced by the new velocity.
+ * @param wx, wy  Velocity of the surrounding fluid.
+ */
+template <Integrator integ>
+inline void kernelMotion( const MoveKernelParam &kp, double *x, double *y, double *vx, double *vy,
+                          double wx, double wy )
+{
+    if ( integ == INTEGRATOR_EXP )
+    {
+        // Terminal velocity, and the slip relative to it.
+        const double vinf_x = wx + kp.g_tau_x;
+        const double vinf_y = wy + kp.g_tau_y;
+        const double dvx = *vx - vinf_x;
+        const double dvy = *vy - vinf_y;
+
+        *vx = vinf_x + dvx * kp.exp_decay;
+        *vy = vinf_y + dvy * kp.exp_decay;
+        *x = (*x + vinf_x * kp.dt) + dvx * kp.exp_disp;
+        *y = (*y + vinf_y * kp.dt) + dvy * kp.exp_disp;
+    }
+    else
+    {
+        *vx = *vx + (kp.inv_tau_a * (wx - *vx) + kp.g_x) * kp.dt;
+        *vy = *vy + (kp.inv_tau_a * (wy - *vy) + kp.g_y) * kp.dt;
+        *x = *x + *vx * kp.dt;
+        *y = *y + *vy * kp.dt;
+    }
+}
+
+/**
+ * The new amount of CO2 (in gram) in one particle; the scalar reference of the kernels.
+ * The uptake is linear in the amount of CO2 that can still be absorbed. INTEGRATOR_EULER
+ * takes an explicit step, INTEGRATOR_EXP an implicit one, which never passes the
+ * saturation and stays stable for dt above tau_m.
+ * @param kp        The kernel constants.
+ * @param gram_co2  Current amount of CO2 in the particle.
+ * @param y         Height of the particle.
+ * @param vx, vy    Velocity of the particle.
+ * @return          The new amount of CO2 in the particle.
+ */
+template <Integrator integ>
+inline double kernelGramCO2( const MoveKernelParam &kp, double gram_co2, double y, double vx, double vy )
+{
+    // Fraction of free MEA, used as a "correction" factor.
+    const double correction_factor = ( kp.mole_mea_total - 2.0 * (gram_co2 / kp.co2_mole_mass) ) / kp.mole_total;
+
+    // Losing CO2 is endothermic.
+    if ( correction_factor <= 0 )
+        return gram_co2;
+
+    const double Re_p = sqrt( vx * vx + vy * vy ) * kp.re_factor;
+    const double Sh = 2.0 + kp.sh_factor * sqrt( Re_p );
+
+    const double y_rel = y / kp.height;
+    const double mass_frac = kp.mass_frac_b * (1 - y_rel) + kp.mass_frac_t * y_rel;
+
+    if ( integ == INTEGRATOR_EXP )
+    {
+        // Backward Euler on d(gram)/dt = (gram_sat - gram) / tau_m.
+        const double rate = Sh * kp.uptake_factor * mass_frac;
+        return gram_co2 + rate / (1 + rate) * (kp.gram_sat - gram_co2);
+    }
+
+    return gram_co2 + Sh * kp.dm_factor * mass_frac * correction_factor;
+}
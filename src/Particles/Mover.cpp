@@ -17,13 +17,13 @@
 #include "Mover.h"
 
 #include "ParticleArray.h"
-#include "Particle.h"
+#include "MoveKernel.h"
 
 #include "Channel/Channel.h"
 
+#include "Random/Random.h"
+
 #include <vector>
-#include <algorithm>
-#include <utility>
 
 
 // Constructor / Destructor
@@ -49,169 +49,282 @@ Mover::Mover( const ScrubberParam &param, Channel *channel )
 
     this->radius = param.channel.radius;
 
+    this->channel = channel;
+
     // FIXME: Cast to enum from integer (thanks to parameter parser sucking).
-    this->bounce_model = (BounceModel) param.channel.bounce_model;
+    this->integrator = (Integrator) param.integrator;
+
+    this->seed = param.seed;
+    this->step = 0;
+
+    // Constants of the integration kernel
+    const Vector2d g_eff = (beta - 1) / (beta + 0.5) * gravity;
+
+    kp.dt = dt;
+    kp.inv_tau_a = 1 / tau_a;
+    kp.g_x = g_eff(0);
+    kp.g_y = g_eff(1);
+
+    kp.exp_decay = exp( -dt / tau_a );
+    kp.exp_disp = tau_a * (1 - kp.exp_decay);
+    kp.g_tau_x = g_eff(0) * tau_a;
+    kp.g_tau_y = g_eff(1) * tau_a;
+
+    kp.height = param.channel.height;
+    kp.radius = radius;
+
+    kp.mass_frac_b = channel->massFracAt( Vector2d( 0, 0 ) );
+    kp.mass_frac_t = channel->massFracAt( Vector2d( 0, kp.height ) );
+
+    kp.re_factor = pdiameter / nu;
+    kp.sh_factor = 0.66 * pow( nu / co2_diffusivity, 1.0 / 3 );
+    kp.co2_mole_mass = co2_mole_mass;
+    kp.mole_mea_total = mole_mea_total;
+    kp.mole_total = mole_mea_total + mole_solvent;
+    kp.dm_factor = PI * pdiameter * co2_density * co2_diffusivity * dt * 1000.0;
+    kp.gram_sat = mole_mea_total * co2_mole_mass / 2;
+    kp.uptake_factor = 2 * kp.dm_factor / (co2_mole_mass * kp.mole_total);
+
+    // Pick the widest kernel this cpu can run
+    KernelISA isa = detectKernelISA();
+    this->kernel = getMoveKernel( isa, integrator );
+    printf( "Particle kernel: %s\n", kernelISAName( isa ) );
+}
 
-    this->channel = channel;
+Mover::~Mover()
+{
 }
 
 
 // Private Methods
-void Mover::bounceWall( const Vector2d &old_pos, Vector2d *new_pos, Vector2d *vel )
+void Mover::bounceWall( const Vector2d &old_pos, Vector2d *new_pos, Vector2d *vel, double h )
 {
-    switch( bounce_model ) {
-        case BOUNCE_STICK:
-            // Already handled in doMove()
-            break;
-        case BOUNCE_SLICOLL:
-            const Vector2d old_vel = *vel;
-
-            // Time it took the particle to get to the wall from its old position
-            const double time_before = ( radius - abs( old_pos(0) ) ) / abs( old_vel(0) );
-
-            // Position of particle when it hit the wall
-            const Vector2d wall_pos( ( old_pos(0) < 0 ) ? -radius : radius,
-                                     old_pos(1) + time_before * old_vel(1) );
-
-            // New velocity
-            *vel = Vector2d( - c_restitution * old_vel(0),
-                             old_vel(1) + c_friction * ( 1 + c_restitution ) * old_vel(0) );
-
-            // New position
-            *new_pos = wall_pos + (*vel) * ( dt - time_before );
-            break;
-    }
+    // BOUNCE_STICK never gets here, the ModelMover removes those particles.
+    const Vector2d old_vel = *vel;
+
+    // Time it took the particle to get to the wall from its old position
+    const double time_before = ( radius - abs( old_pos(0) ) ) / abs( old_vel(0) );
+
+    // Position of particle when it hit the wall
+    const Vector2d wall_pos( ( old_pos(0) < 0 ) ? -radius : radius,
+                             old_pos(1) + time_before * old_vel(1) );
+
+    // New velocity
+    *vel = Vector2d( - c_restitution * old_vel(0),
+                     old_vel(1) + c_friction * ( 1 + c_restitution ) * old_vel(0) );
+
+    // New position
+    *new_pos = wall_pos + (*vel) * ( h - time_before );
 }
 
-double Mover::newGramCO2( const Particle &p )
+void Mover::moveParticle( Vector2d *pos, Vector2d *vel, const Vector2d &v_vel )
 {
-    // Readability
-    const double p_gram_co2 = p.getGramCO2();
-    const double p_mole_co2 = p_gram_co2 / co2_mole_mass;
-    const Vector2d pos = p.getPos();
-    const Vector2d vel = p.getVel();
+    double x = (*pos)(0), y = (*pos)(1);
+    double vx = (*vel)(0), vy = (*vel)(1);
 
-    // Get the concentration at the heigth of the particle
-    double fl_mass_frac_co2 = channel->massFracAt( pos );
+    // Same arithmetic as the integration kernels.
+    if ( integrator == INTEGRATOR_EXP )
+        kernelMotion<INTEGRATOR_EXP>( kp, &x, &y, &vx, &vy, v_vel(0), v_vel(1) );
+    else
+        kernelMotion<INTEGRATOR_EULER>( kp, &x, &y, &vx, &vy, v_vel(0), v_vel(1) );
 
-    // Calculate some dimensionless numbers
-    double Re_p = blitz::norm( vel ) * pdiameter / nu ;
-    static double Sc = nu / co2_diffusivity;
-    double Sh = 2.0 + 0.66 * sqrt( Re_p ) * pow( Sc, 1.0 / 3 );
+    *pos = Vector2d( x, y );
+    *vel = Vector2d( vx, vy );
+}
 
-    // Calculating the fraction of free MEA in the particle, and use it as a "correction" factor
-    double correction_factor = ( mole_mea_total - 2.0 * p_mole_co2 ) / ( mole_mea_total + mole_solvent );
+double Mover::newGramCO2( double p_gram_co2, const Vector2d &pos, const Vector2d &vel )
+{
+    // Same arithmetic as the integration kernels.
+    if ( integrator == INTEGRATOR_EXP )
+        return kernelGramCO2<INTEGRATOR_EXP>( kp, p_gram_co2, pos(1), vel(0), vel(1) );
+    else
+        return kernelGramCO2<INTEGRATOR_EULER>( kp, p_gram_co2, pos(1), vel(0), vel(1) );
+}
 
-    // Break when correction factor is negative, because losing CO2 is endothermic
-    if ( correction_factor <= 0 )
-        return p_gram_co2;
 
-    // Calculating the mass (kg) of CO2 added in a timestep
-    double dm = Sh * PI * pdiameter * co2_density * co2_diffusivity * fl_mass_frac_co2 * dt * correction_factor;
+// ModelMover: Constructor / Destructor
+template <TurbModel turb, BounceModel bounce>
+ModelMover<turb, bounce>::ModelMover( const ScrubberParam &param, Channel *channel )
+    : Mover( param, channel )
+{
+    this->fluid_vel[0] = NULL;
+    this->fluid_vel[1] = NULL;
+}
 
-    // Return the new total amount of co2 in the particle in gram
-    return p_gram_co2 + dm * 1000.0;
+template <TurbModel turb, BounceModel bounce>
+ModelMover<turb, bounce>::~ModelMover()
+{
+    alignedFree( fluid_vel[0] );
+    alignedFree( fluid_vel[1] );
 }
 
 
-// Public Methods
-void Mover::doMove( ParticleArray *particles, StatsStruct *stats )
+// ModelMover: Public Methods
+template <TurbModel turb, BounceModel bounce>
+ColumnMask ModelMover<turb, bounce>::getColumns() const
+{
+    ColumnMask mask = PC_ALL_COLUMNS;
+
+    // Without turbulence the surrounding velocity is the mean velocity, it is not kept.
+    if ( turb == TURB_NONE )
+        mask &= ~( columnBit( PC_V_VEL_X ) | columnBit( PC_V_VEL_Y ) );
+
+    // Only the discrete eddies have a lifetime.
+    if ( turb != TURB_DISCRETE_EDDY )
+        mask &= ~columnBit( PC_COUNT_DOWN );
+
+    // All particles take the same step.
+    mask &= ~columnBit( PC_STEP );
+
+    return mask;
+}
+
+template <TurbModel turb, BounceModel bounce>
+void ModelMover<turb, bounce>::doMove( ParticleArray *particles, StatsStruct *stats )
 {
     /*
      * See Formula 11 in M.F. Cargnelutti and Portela's "Influence of the resuspension on
      * the particle sedimentation in wall-bounded turbulent flows") for the equation of motion.
      */
-    std::vector< std::pair<int,PosBox> > markedParticles;
-    markedParticles.reserve(8000);
+    const int length = particles->getLength();
 
-#pragma omp parallel for
-    for ( int p = 0; p < particles->getLength(); p++ )
+    if ( (int) pos_box.size() < length )
     {
-        // Get the particle.
-        Particle particle = particles->getParticle( p );
+        pos_box.resize( particles->getMaxLength() );
+
+        if ( turb == TURB_NONE )
+        {
+            alignedFree( fluid_vel[0] );
+            alignedFree( fluid_vel[1] );
+
+            // Padded like the columns, so the kernel can load whole vectors.
+            const int padded = (int) pos_box.size() + MOVE_KERNEL_ALIGN;
+            fluid_vel[0] = static_cast<double *>( alignedAlloc( padded, sizeof( double ) ) );
+            fluid_vel[1] = static_cast<double *>( alignedAlloc( padded, sizeof( double ) ) );
 
-        // Readability for rhs.
-        const Vector2d & p_pos = particle.getPos();
-        const Vector2d & p_vel = particle.getVel();
+            for ( int p = 0; p < padded; p++ )
+                fluid_vel[0][p] = fluid_vel[1][p] = 0;
+        }
+    }
 
-        // Get the velocity of the fluid surrounding the particle
-        Vector2d v_vel = particle.getSurroundingVel();
+    double * const v_vel_x = ( turb == TURB_NONE ) ? fluid_vel[0] : particles->getColumn( PC_V_VEL_X );
+    double * const v_vel_y = ( turb == TURB_NONE ) ? fluid_vel[1] : particles->getColumn( PC_V_VEL_Y );
 
-        // Get countdown
-        double count_down = particle.getCountDown();
-        count_down = count_down - dt;
+    // Turbulence: get a new surrounding fluid velocity when the eddy has expired (every
+    // step for the other models). The random numbers only depend on (seed, particle id,
+    // step), not on the thread.
+#pragma omp parallel for
+    for ( int p = 0; p < length; p++ )
+    {
+        double count_down = ( turb == TURB_DISCRETE_EDDY ) ? particles->getCountDown( p ) - dt : 0;
 
         if ( count_down <= 0 )
         {
-            // Get a new surrounding velocity
-            channel->velocityAt( p_pos, p_vel, &v_vel, &count_down );
-            particle.setSurroundingVel( v_vel );
+            Random random( seed, particles->getId( p ), step );
+
+            Vector2d v_vel( v_vel_x[p], v_vel_y[p] );
+            channel->velocityAt<turb>( particles->getPos( p ), particles->getVel( p ), &v_vel, &count_down, &random );
+            v_vel_x[p] = v_vel(0);
+            v_vel_y[p] = v_vel(1);
         }
 
-        particle.setCountDown( count_down );
+        if ( turb == TURB_DISCRETE_EDDY )
+            particles->setCountDown( p, count_down );
+    }
 
-        // Particle equation of motion.
-        const Vector2d dv = (1 / tau_a * (v_vel - p_vel) + (beta - 1) / (beta + 0.5) * gravity ) * dt;
+    // Integrate all particles with the (vectorized) kernel, in aligned blocks.
+    double * const columns[PC_NUM_COLUMNS] = {
+        particles->getColumn( PC_POS_X ), particles->getColumn( PC_POS_Y ),
+        particles->getColumn( PC_VEL_X ), particles->getColumn( PC_VEL_Y ),
+        v_vel_x, v_vel_y,
+        particles->getColumn( PC_COUNT_DOWN ), particles->getColumn( PC_GRAM_CO2 ),
+        particles->getColumn( PC_STEP ) };
 
-        // Set the new particle velocity and calculate the new position
-        Vector2d new_vel = p_vel + dv;
-        Vector2d new_pos = p_pos + new_vel * dt;
+    const int n_blocks = (length + KERNEL_BLOCK - 1) / KERNEL_BLOCK;
 
-        PosBox pos_box = channel->outsideBox( new_pos );
+    // Every block keeps its own statistics, so no thread has to wait for another.
+    block_stats.assign( n_blocks, StatsStruct() );
 
-        if ( bounce_model != BOUNCE_STICK && pos_box != P_INSIDE )
-        {
-            bounceWall( p_pos, &new_pos, &new_vel );
-            pos_box = channel->outsideBox( new_pos );
-        }
+#pragma omp parallel for
+    for ( int b = 0; b < n_blocks; b++ )
+    {
+        const int begin = b * KERNEL_BLOCK;
+        const int end = min( begin + KERNEL_BLOCK, length );
 
-        if ( pos_box == P_INSIDE )
-        {
-            // Give the particle his new position.
-            particle.setPos( new_pos );
-            particle.setVel( new_vel );
+        kernel( kp, columns, begin, end, &pos_box[0] );
 
-            particle.setGramCO2( newGramCO2( particle ) );
+        // The kernel left the particles outside the box untouched: bounce or mark them.
+        StatsStruct &partial = block_stats[b];
 
-            particles->setParticle( p, particle );
-        }
-        else
+        for ( int p = begin; p < end; p++ )
         {
-            // Mark the particle
-            #pragma omp critical
-            markedParticles.push_back( std::pair<int,PosBox>( p, pos_box ) );
+            if ( pos_box[p] == P_INSIDE )
+                continue;
+
+            if ( bounce == BOUNCE_SLICOLL )
+            {
+                // Readability
+                const Vector2d p_pos = particles->getPos( p );
+
+                // Particle equation of motion, as in the kernel.
+                Vector2d new_pos = p_pos;
+                Vector2d new_vel = particles->getVel( p );
+                moveParticle( &new_pos, &new_vel, Vector2d( v_vel_x[p], v_vel_y[p] ) );
+
+                if ( pos_box[p] == P_OUTSIDE_SIDE )
+                    partial.bounces++;
+
+                bounceWall( p_pos, &new_pos, &new_vel, dt );
+                pos_box[p] = channel->outsideBox( new_pos );
+
+                if ( pos_box[p] == P_INSIDE )
+                {
+                    particles->setPos( p, new_pos );
+                    particles->setVel( p, new_vel );
+                    particles->setGramCO2( p, newGramCO2( particles->getGramCO2( p ), new_pos, new_vel ) );
+                    continue;
+                }
+            }
+
+            // Get the particles CO2
+            partial.captured_co2 += particles->getGramCO2( p );
+
+            // Update the stats
+            switch ( pos_box[p] ) {
+                case P_OUTSIDE_TOP:
+                    partial.p_top++;
+                    break;
+                case P_OUTSIDE_BOTTOM:
+                    partial.p_bottom++;
+                    break;
+                case P_OUTSIDE_SIDE:
+                    partial.p_wall++;
+                    break;
+            }
         }
     }
 
-    // Sort the marked particles in descending order
-    std::sort( markedParticles.begin(), markedParticles.end() );
-
-    std::vector< std::pair<int,PosBox> >::reverse_iterator rii;
+    // Reduce the statistics in block order (independent of the number of threads).
+    int removed = 0;
 
-    // Loop in reverse order (remove high-numbered particles first)
-    for( rii = markedParticles.rbegin(); rii != markedParticles.rend(); ++rii )
+    for ( int b = 0; b < n_blocks; b++ )
     {
-        const int p = (*rii).first;
-        const PosBox pos_box = (*rii).second;
-
-        Particle particle = particles->getParticle( p );
-
-        // Get the particles CO2
-        stats->captured_co2 += particle.getGramCO2();
-
-        // Update the stats
-        switch ( pos_box ) {
-            case P_OUTSIDE_TOP:
-                stats->p_top++;
-                break;
-            case P_OUTSIDE_BOTTOM:
-                stats->p_bottom++;
-                break;
-            case P_OUTSIDE_SIDE:
-                stats->p_wall++;
-                break;
-        }
-        // Remove the particle
-        particles->remove( p );
+        stats->add( block_stats[b] );
+        removed += block_stats[b].p_top + block_stats[b].p_bottom + block_stats[b].p_wall;
     }
+
+    // Remove the particles that left the box (P_INSIDE is zero, all others are removed).
+    if ( removed > 0 )
+        particles->compact( &pos_box[0] );
+
+    step++;
 }
+
+
+// All combinations of the models, created in main().
+template class ModelMover<TURB_NONE, BOUNCE_STICK>;
+template class ModelMover<TURB_NONE, BOUNCE_SLICOLL>;
+template class ModelMover<TURB_DISCRETE_EDDY, BOUNCE_STICK>;
+template class ModelMover<TURB_DISCRETE_EDDY, BOUNCE_SLICOLL>;
+template class ModelMover<TURB_LANGEVIN, BOUNCE_STICK>;
+template class ModelMover<TURB_LANGEVIN, BOUNCE_SLICOLL>;
@@ -17,22 +17,25 @@
 // Headers
 #include "Typedefs.h"
 #include "Scrubber.h"
+#include "MoveKernel.h"
+#include "ParticleArray.h"
+
+#include <vector>
 
 
 // Forward Declarations
-class ParticleArray;
 class Channel;
-class Particle;
 
 
 /**
  * Moves the particles.
  * Can move the particles based on a equation of motion and do checks on them
  * to see if they're still in the channel. Also has various methods of bouncing
- * of walls.
+ * of walls. This base class holds the shared state, the actual moving is done
+ * by a ModelMover, which is specialized for the turbulence and bounce model.
  */
 class Mover {
-private:
+protected:
     Vector2d gravity;
     double dt;
     double beta;
@@ -53,39 +56,103 @@ private:
 
     double radius;
 
-    BounceModel bounce_model;
-
     Channel *channel;
 
+    Integrator integrator;
+
+    uint64 seed;  /// Seed of the random number generators.
+    int step;     /// Number of the current timestep.
+
+    // Integration kernel
+    MoveKernelParam kp;
+    MoveKernelFunc kernel;
+    std::vector<int> pos_box;  /// PosBox of every particle after the kernel.
+
+    std::vector<StatsStruct> block_stats;  /// Statistics of every block of particles.
+
+    /// Number of particles per kernel call (a multiple of MOVE_KERNEL_ALIGN).
+    static const int KERNEL_BLOCK = 1024;
+
     /**
-     * Bounces particles off the wall based on different models. Changes position and velocity.
+     * Bounces particles off the wall with a sliding collision. Changes position and velocity.
      * @param old_pos  Old position of the particle.
      * @param new_pos  New position of the particle.
      * @param new_vel  Velocity of the particle.
+     * @param h        Length of the step from old_pos to new_pos.
+     */
+    void bounceWall( const Vector2d &old_pos, Vector2d *new_pos, Vector2d *new_vel, double h );
+
+    /**
+     * Advances one particle over a timestep with the integrator (like the kernel does).
+     * @param pos    Position of the particle, replaced by the new position.
+     * @param vel    Velocity of the particle, replaced by the new velocity.
+     * @param v_vel  Velocity of the surrounding fluid.
      */
-    void bounceWall( const Vector2d &old_pos, Vector2d *new_pos, Vector2d *new_vel );
+    void moveParticle( Vector2d *pos, Vector2d *vel, const Vector2d &v_vel );
 
     /**
      * Calculates the new amount (in gram) of totally absorbed CO2 in the particle.
-     * @param p  The particle with its properties.
-     * @return   The new total amount of CO2 in the particle.
+     * @param p_gram_co2  Current amount (in gram) of CO2 in the particle.
+     * @param pos         Position of the particle.
+     * @param vel         Velocity of the particle.
+     * @return            The new total amount of CO2 in the particle.
      */
-    double newGramCO2( const Particle &p );
+    double newGramCO2( double p_gram_co2, const Vector2d &pos, const Vector2d &vel );
 
 public:
     /**
      * Constructor.
      * @param param    Struct of parameters.
      * @param channel  The channel with continuous phase.
-     * @param emitter  Particle emitter/resetter.
      */
     Mover( const ScrubberParam &param, Channel *channel );
 
+    /**
+     * Destructor.
+     */
+    virtual ~Mover();
+
+    /**
+     * The columns a ParticleArray needs to have for this mover.
+     * @return  Mask of the needed columns.
+     */
+    virtual ColumnMask getColumns() const = 0;
+
     /**
      * Moves the particles and does checks on them.
      * @param particles  The array of particles which will be checked.
      * @param stats      Keeps track of statistics.
      * @see              bounceWall()
      */
+    virtual void doMove( ParticleArray *particles, StatsStruct *stats ) = 0;
+};
+
+
+/**
+ * Mover specialized at compile time for a turbulence and a bounce model, so the
+ * inner loops carry no per-particle model switches. Instantiated in Mover.cpp
+ * for every combination of the models.
+ */
+template <TurbModel turb, BounceModel bounce>
+class ModelMover : public Mover {
+private:
+    // Surrounding fluid velocity of this step, if the particles don't store it (TURB_NONE).
+    double *fluid_vel[2];
+
+public:
+    /**
+     * Constructor.
+     * @param param    Struct of parameters.
+     * @param channel  The channel with continuous phase.
+     */
+    ModelMover( const ScrubberParam &param, Channel *channel );
+
+    /**
+     * Destructor.
+     */
+    ~ModelMover();
+
+    ColumnMask getColumns() const;
+
     void doMove( ParticleArray *particles, StatsStruct *stats );
 };
@@ -16,43 +16,204 @@
 // Headers
 #include "ParticleArray.h"
 
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+
+// Helper functions
+void *alignedAlloc( int count, size_t size )
+{
+    const size_t bytes = count * size;
+    void *ptr = NULL;
+
+#ifdef _MSC_VER
+    ptr = _aligned_malloc( bytes, ParticleArray::alignment );
+#else
+    if ( posix_memalign( &ptr, ParticleArray::alignment, bytes ) != 0 )
+        ptr = NULL;
+#endif
+
+    if ( ptr == NULL )
+    {
+        printf( "Could not allocate memory for %d particles, exiting\n", count );
+        exit( 1 );
+    }
+
+    return ptr;
+}
+
+void alignedFree( void *ptr )
+{
+#ifdef _MSC_VER
+    _aligned_free( ptr );
+#else
+    free( ptr );
+#endif
+}
+
 
 // Constructor / Destructor
-ParticleArray::ParticleArray( int initiallength )
+ParticleArray::ParticleArray( int initiallength, ColumnMask column_mask )
 {
-    particles.resize( initiallength );
+    // Pad the columns to a whole number of vectors.
+    const int per_vector = alignment / sizeof( double );
+    const int padded = ( (initiallength + per_vector - 1) / per_vector ) * per_vector;
+
+    for ( int c = 0; c < PC_NUM_COLUMNS; c++ )
+    {
+        if ( !( column_mask & columnBit( (ParticleColumn) c ) ) )
+        {
+            columns[c] = NULL;
+            scratch[c] = NULL;
+            continue;
+        }
+
+        columns[c] = static_cast<double *>( alignedAlloc( padded, sizeof( double ) ) );
+        scratch[c] = static_cast<double *>( alignedAlloc( padded, sizeof( double ) ) );
 
+        for ( int p = 0; p < padded; p++ )
+            columns[c][p] = 0;
+    }
+
+    ids = static_cast<uint64 *>( alignedAlloc( padded, sizeof( uint64 ) ) );
+    scratch_ids = static_cast<uint64 *>( alignedAlloc( padded, sizeof( uint64 ) ) );
+
+    maxlength = initiallength;
     length = 0;
-    nextIndex = 0;
+    next_id = 0;
+}
+
+ParticleArray::~ParticleArray()
+{
+    for ( int c = 0; c < PC_NUM_COLUMNS; c++ )
+    {
+        alignedFree( columns[c] );
+        alignedFree( scratch[c] );
+    }
+
+    alignedFree( ids );
+    alignedFree( scratch_ids );
 }
 
 
 // Public methods
 void ParticleArray::add( const Particle &particle )
 {
-    particles(length) = particle;
+    setParticle( length, particle );
+    ids[length] = next_id;
     length++;
-    nextIndex++;
+    next_id++;
 }
 
-Particle ParticleArray::remove( int p )
+void ParticleArray::compact( const int *remove )
 {
-    Particle temp = particles( p );
-    particles( p ) = particles( length - 1 ); // [ 1 2 3 4 5 ] at length 5, with particle nr 2 (index 1) outside of the box becomes
-    length--;                                 // [ 1 5 3 4 5 ] with length 4;
-    return temp;
+    // Everything before the first removed particle stays where it is.
+    int first = 0;
+    while ( first < length && !remove[first] )
+        first++;
+
+    if ( first == length )
+        return;
+
+    const int n_blocks = (length - first + COMPACT_BLOCK - 1) / COMPACT_BLOCK;
+
+    // Count the particles every block keeps.
+    std::vector<int> offset( n_blocks + 1, 0 );
+
+#pragma omp parallel for
+    for ( int b = 0; b < n_blocks; b++ )
+    {
+        const int begin = first + b * COMPACT_BLOCK;
+        const int end = min( begin + COMPACT_BLOCK, length );
+
+        int kept = 0;
+        for ( int p = begin; p < end; p++ )
+            kept += !remove[p];
+
+        offset[b + 1] = kept;
+    }
+
+    // Exclusive prefix sum: the destination of every block.
+    offset[0] = first;
+    for ( int b = 0; b < n_blocks; b++ )
+        offset[b + 1] += offset[b];
+
+    const int new_length = offset[n_blocks];
+
+    // Scatter the kept particles into the scratch columns, and copy them back.
+#pragma omp parallel for
+    for ( int b = 0; b < n_blocks; b++ )
+    {
+        const int begin = first + b * COMPACT_BLOCK;
+        const int end = min( begin + COMPACT_BLOCK, length );
+
+        for ( int c = 0; c < PC_NUM_COLUMNS; c++ )
+        {
+            if ( columns[c] == NULL )
+                continue;
+
+            const double * const src = columns[c];
+            double * const dst = scratch[c];
+
+            int q = offset[b];
+            for ( int p = begin; p < end; p++ )
+                if ( !remove[p] )
+                    dst[q++] = src[p];
+        }
+
+        int q = offset[b];
+        for ( int p = begin; p < end; p++ )
+            if ( !remove[p] )
+                scratch_ids[q++] = ids[p];
+    }
+
+    const int moved = new_length - first;
+
+#pragma omp parallel for
+    for ( int c = 0; c < PC_NUM_COLUMNS; c++ )
+        if ( columns[c] != NULL )
+            memcpy( columns[c] + first, scratch[c] + first, moved * sizeof( double ) );
+
+    memcpy( ids + first, scratch_ids + first, moved * sizeof( uint64 ) );
+
+    length = new_length;
 }
 
 
 // Getters and Setters
-const Particle &ParticleArray::getParticle( int p ) const
+Particle ParticleArray::getParticle( int p ) const
 {
-    return particles( p );
+    Particle particle( getPos( p ), getVel( p ) );
+
+    if ( hasColumn( PC_V_VEL_X ) )
+        particle.setSurroundingVel( getSurroundingVel( p ) );
+    if ( hasColumn( PC_COUNT_DOWN ) )
+        particle.setCountDown( getCountDown( p ) );
+    particle.setGramCO2( getGramCO2( p ) );
+
+    return particle;
 }
 
-void ParticleArray::setParticle( int p, Particle particle )
+void ParticleArray::setParticle( int p, const Particle &particle )
 {
-    this->particles( p ) = particle;
+    setPos( p, particle.getPos() );
+    setVel( p, particle.getVel() );
+    if ( hasColumn( PC_V_VEL_X ) )
+        setSurroundingVel( p, particle.getSurroundingVel() );
+    if ( hasColumn( PC_COUNT_DOWN ) )
+        setCountDown( p, particle.getCountDown() );
+    setGramCO2( p, particle.getGramCO2() );
+
+    // No step size yet, the mover starts with its own.
+    if ( hasColumn( PC_STEP ) )
+        setStep( p, 0 );
 }
 
 int ParticleArray::getLength() const
@@ -62,5 +223,23 @@ int ParticleArray::getLength() const
 
 int ParticleArray::getMaxLength() const
 {
-    return particles.size();
+    return maxlength;
+}
+
+int ParticleArray::find( uint64 id ) const
+{
+    int lo = 0;
+    int hi = length;
+
+    while ( lo < hi )
+    {
+        const int mid = lo + ( hi - lo ) / 2;
+
+        if ( ids[mid] < id )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return ( lo < length && ids[lo] == id ) ? lo : -1;
 }
@@ -15,29 +15,102 @@
 #pragma once
 
 // Headers
-#include <blitz/array.h>
-
 #include "Typedefs.h"
 #include "Particle.h"
 
+#include <stddef.h>
+
+
+// Enums
+enum ParticleColumn
+{
+    PC_POS_X,
+    PC_POS_Y,
+    PC_VEL_X,
+    PC_VEL_Y,
+    PC_V_VEL_X,
+    PC_V_VEL_Y,
+    PC_COUNT_DOWN,
+    PC_GRAM_CO2,
+    PC_STEP,        // Sub-step size of the adaptive mover
+    PC_NUM_COLUMNS
+};
+
+
+// Column masks
+typedef unsigned int ColumnMask;  /// Set of columns, bit c is set when column c is stored.
+
+const ColumnMask PC_ALL_COLUMNS = (1u << PC_NUM_COLUMNS) - 1;
+
+inline ColumnMask columnBit( ParticleColumn c )
+{
+    return 1u << c;
+}
+
+
+// Helper functions
+/**
+ * Allocates memory aligned to ParticleArray::alignment bytes, exits when out of memory.
+ * @param count  Number of elements.
+ * @param size   Size of one element.
+ * @return       Pointer to the memory, free it with alignedFree().
+ */
+void *alignedAlloc( int count, size_t size );
+
+/**
+ * Frees memory allocated with alignedAlloc().
+ * @param ptr  Pointer to the memory.
+ */
+void alignedFree( void *ptr );
+
 
 /**
  * Holds and manages the particles.
+ * The particles are stored as a structure of arrays: every property has its own
+ * contiguous column, aligned and padded so that it can be processed with vector loads.
+ * Columns that are not in the mask given to the constructor are not allocated at all
+ * (e.g. the eddy columns when there is no turbulence model).
+ * Every particle has an id, numbered in the order the particles are added, that stays
+ * with it while it is in the array (the index does not, removing particles moves the
+ * ones after them). Removing keeps the order, so the ids are increasing along the
+ * array, and find() is a binary search.
  */
 class ParticleArray
 {
 private:
-    blitz::Array<Particle, 1> particles; /// The array for the particles.
+    double *columns[PC_NUM_COLUMNS]; /// The property columns of the particles (NULL if not stored).
+    uint64 *ids;                     /// Id of every particle, increasing along the array.
 
+    // Second set of columns, the target of compact().
+    double *scratch[PC_NUM_COLUMNS];
+    uint64 *scratch_ids;
+
+    int maxlength; /// Maximum number of particles.
     int length;    /// Keeps track of how many particles there are.
-    int nextIndex; /// Contains the index of the next particle when added.
+    uint64 next_id; /// Id of the next particle when added.
+
+    // Not copyable, the columns are owned by this array.
+    ParticleArray( const ParticleArray & );
+    ParticleArray &operator=( const ParticleArray & );
 
 public:
+    /// Alignment (in bytes) of the columns, and the granularity they are padded to.
+    static const int alignment = 64;
+
+    /// Number of particles per block in compact().
+    static const int COMPACT_BLOCK = 4096;
+
     /**
      * Constructor.
      * @param initiallength  Initial length of the particle array.
+     * @param column_mask    The columns to store, the others are dropped.
+     */
+    ParticleArray( int initiallength, ColumnMask column_mask = PC_ALL_COLUMNS );
+
+    /**
+     * Destructor.
      */
-    ParticleArray( int initiallength );
+    ~ParticleArray();
 
     /**
      * Add a particle to the array.
@@ -46,25 +119,29 @@ public:
     void add( const Particle &particle );
 
     /**
-     * Remove a particle from the array.
-     * @param p  Index of the particle in the array.
-     * @return   Removed particle.
+     * Remove many particles at once, keeping the order of the remaining particles.
+     * A parallel stream compaction: every block counts the particles it keeps, a prefix
+     * sum over the counts gives the destination of every block, and the blocks are then
+     * copied independently. Only the part after the first removed particle is moved.
+     * @param remove  For every particle, zero if it stays and nonzero if it is removed.
      */
-    Particle remove( int p );
+    void compact( const int *remove );
 
     /**
-     * Get particle p.
+     * Get a copy of particle p.
+     * Properties of which the column is not stored are left at their default.
      * @param p  Index of the particle in the array.
      * @return   The particle at position p in the array.
      */
-    const Particle &getParticle( int p ) const;
+    Particle getParticle( int p ) const;
 
     /**
      * Write particle to array.
+     * Properties of which the column is not stored are ignored.
      * @param p         Index of the particle in the array.
      * @param particle  Particle which will be written to index p.
      */
-    void setParticle( int p, Particle particle );
+    void setParticle( int p, const Particle &particle );
 
     /**
      * Get the current array length.
@@ -77,4 +154,122 @@ public:
      * @return  The maximal array length.
      */
     int getMaxLength() const;
+
+    /**
+     * Checks whether a column is stored.
+     * @param c  The column.
+     * @return   True if the column is stored.
+     */
+    inline bool hasColumn( ParticleColumn c ) const
+    {
+        return columns[c] != NULL;
+    }
+
+    /**
+     * Get a column of the array for direct (vectorized) access.
+     * The column is aligned to ParticleArray::alignment bytes, and padded to a
+     * multiple of that size, so whole vectors can be loaded up to getMaxLength().
+     * @param c  The column.
+     * @return   Pointer to the first element of the column, NULL if it is not stored.
+     */
+    inline double *getColumn( ParticleColumn c )
+    {
+        return columns[c];
+    }
+
+    inline const double *getColumn( ParticleColumn c ) const
+    {
+        return columns[c];
+    }
+
+    /**
+     * Get the id of particle p.
+     * Particles are numbered in the order they were added.
+     * @param p  Index of the particle in the array.
+     * @return   The id of the particle.
+     */
+    inline uint64 getId( int p ) const
+    {
+        return ids[p];
+    }
+
+    /**
+     * Get the ids of all particles, for direct access (increasing).
+     * @return  Pointer to the id of the first particle.
+     */
+    inline const uint64 *getIds() const
+    {
+        return ids;
+    }
+
+    /**
+     * Find a particle by its id.
+     * @param id  The id of the particle.
+     * @return    Index of the particle in the array, -1 if it is not (or no longer) there.
+     */
+    int find( uint64 id ) const;
+
+    // In-place accessors of the properties of particle p (the column has to be stored).
+    inline Vector2d getPos( int p ) const
+    {
+        return Vector2d( columns[PC_POS_X][p], columns[PC_POS_Y][p] );
+    }
+
+    inline void setPos( int p, const Vector2d &pos )
+    {
+        columns[PC_POS_X][p] = pos(0);
+        columns[PC_POS_Y][p] = pos(1);
+    }
+
+    inline Vector2d getVel( int p ) const
+    {
+        return Vector2d( columns[PC_VEL_X][p], columns[PC_VEL_Y][p] );
+    }
+
+    inline void setVel( int p, const Vector2d &vel )
+    {
+        columns[PC_VEL_X][p] = vel(0);
+        columns[PC_VEL_Y][p] = vel(1);
+    }
+
+    inline Vector2d getSurroundingVel( int p ) const
+    {
+        return Vector2d( columns[PC_V_VEL_X][p], columns[PC_V_VEL_Y][p] );
+    }
+
+    inline void setSurroundingVel( int p, const Vector2d &v_vel )
+    {
+        columns[PC_V_VEL_X][p] = v_vel(0);
+        columns[PC_V_VEL_Y][p] = v_vel(1);
+    }
+
+    inline double getCountDown( int p ) const
+    {
+        return columns[PC_COUNT_DOWN][p];
+    }
+
+    inline void setCountDown( int p, double count_down )
+    {
+        columns[PC_COUNT_DOWN][p] = count_down;
+    }
+
+    inline double getGramCO2( int p ) const
+    {
+        return columns[PC_GRAM_CO2][p];
+    }
+
+    inline void setGramCO2( int p, double gram_co2 )
+    {
+        columns[PC_GRAM_CO2][p] = gram_co2;
+    }
+
+    inline double getStep( int p ) const
+    {
+        return columns[PC_STEP][p];
+    }
+
+    inline void setStep( int p, double step )
+    {
+        columns[PC_STEP][p] = step;
+    }
 };
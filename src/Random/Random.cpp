@@ -0,0 +1,148 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+// Headers
+#include "Random.h"
+
+#include <math.h>
+
+
+// Static members
+unsigned int Random::kn[128];
+double Random::wn[128];
+double Random::fn[128];
+
+// Filled during static initialization, before any thread can draw numbers.
+const bool Random::tables_set = Random::setTables();
+
+
+// Constructor / Destructor
+Random::Random( uint64 seed, uint64 stream, unsigned int step )
+{
+    key[0] = (unsigned int) seed;
+    key[1] = (unsigned int) (seed >> 32);
+
+    counter[0] = (unsigned int) stream;
+    counter[1] = (unsigned int) (stream >> 32);
+    counter[2] = step;
+    counter[3] = 0;
+
+    used = 4;
+}
+
+
+// Private Methods
+void Random::nextBlock()
+{
+    // Philox4x32 constants
+    const unsigned int M0 = 0xD2511F53;
+    const unsigned int M1 = 0xCD9E8D57;
+    const unsigned int W0 = 0x9E3779B9;
+    const unsigned int W1 = 0xBB67AE85;
+
+    unsigned int c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    unsigned int k0 = key[0], k1 = key[1];
+
+    for ( int round = 0; round < 10; round++ )
+    {
+        const uint64 p0 = (uint64) M0 * c0;
+        const uint64 p1 = (uint64) M1 * c2;
+
+        const unsigned int n0 = (unsigned int) (p1 >> 32) ^ c1 ^ k0;
+        const unsigned int n2 = (unsigned int) (p0 >> 32) ^ c3 ^ k1;
+
+        c0 = n0;
+        c1 = (unsigned int) p1;
+        c2 = n2;
+        c3 = (unsigned int) p0;
+
+        k0 += W0;
+        k1 += W1;
+    }
+
+    block[0] = c0;
+    block[1] = c1;
+    block[2] = c2;
+    block[3] = c3;
+    used = 0;
+
+    // Next block
+    counter[3]++;
+}
+
+bool Random::setTables()
+{
+    // See G. Marsaglia and W. W. Tsang, "The Ziggurat Method for Generating Random Variables" (2000).
+    const double m1 = 2147483648.0;
+    const double vn = 9.91256303526217e-3;
+
+    double dn = 3.442619855899;
+    double tn = dn;
+    const double q = vn / exp( -0.5 * dn * dn );
+
+    kn[0] = (unsigned int) ( (dn / q) * m1 );
+    kn[1] = 0;
+
+    wn[0] = q / m1;
+    wn[127] = dn / m1;
+
+    fn[0] = 1.0;
+    fn[127] = exp( -0.5 * dn * dn );
+
+    for ( int i = 126; i >= 1; i-- )
+    {
+        dn = sqrt( -2.0 * log( vn / dn + exp( -0.5 * dn * dn ) ) );
+        kn[i+1] = (unsigned int) ( (dn / tn) * m1 );
+        tn = dn;
+        fn[i] = exp( -0.5 * dn * dn );
+        wn[i] = dn / m1;
+    }
+
+    return true;
+}
+
+double Random::normalTail( int hz, int iz )
+{
+    const double r = 3.442620;  // Start of the right tail
+
+    for ( ;; )
+    {
+        double x = hz * wn[iz];
+
+        // The base strip: sample from the tail.
+        if ( iz == 0 )
+        {
+            double y;
+            do
+            {
+                x = -log( 1.0 - rand53() ) / r;
+                y = -log( 1.0 - rand53() );
+            } while ( y + y < x * x );
+
+            return ( hz > 0 ) ? r + x : -r - x;
+        }
+
+        // The wedges: accept if under the density.
+        if ( fn[iz] + rand53() * (fn[iz-1] - fn[iz]) < exp( -0.5 * x * x ) )
+            return x;
+
+        // Rejected, try again.
+        hz = (int) randInt();
+        iz = hz & 127;
+
+        if ( magnitude( hz ) < kn[iz] )
+            return hz * wn[iz];
+    }
+}
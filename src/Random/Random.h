@@ -0,0 +1,122 @@
+// Copyright (c) 2009, Pietje Bell <pietjebell@ana-chan.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+// Headers
+#include "Typedefs.h"
+
+
+// Constants
+const uint64 RANDOM_STREAM_EMITTER = ~0ULL;  /// Stream of the emitters (particles use their id).
+
+
+/**
+ * Counter-based random number generator with a fast normal distribution.
+ * Uses Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", 2011):
+ * the numbers are a pure function of the key (the seed) and a counter made of the
+ * stream and the step, so every (seed, stream, step) gives the same sequence no
+ * matter which thread draws it, and creating a generator costs nothing.
+ * Normally distributed numbers are drawn with the Ziggurat method of Marsaglia and Tsang.
+ */
+class Random
+{
+private:
+    unsigned int key[2];     /// The seed.
+    unsigned int counter[4]; /// Stream (2 words), step and block number.
+    unsigned int block[4];   /// Current block of random numbers.
+    int used;                /// Number of words of the block that were used.
+
+    // Ziggurat tables (shared by all instances)
+    static unsigned int kn[128];
+    static double wn[128];
+    static double fn[128];
+
+    /**
+     * Fills the Ziggurat tables.
+     * @return  Always true.
+     */
+    static bool setTables();
+    static const bool tables_set;
+
+    /**
+     * Generates the next block of four random words.
+     */
+    void nextBlock();
+
+    /**
+     * Slow path of the Ziggurat method (base strip and wedges).
+     * @param hz  The random integer that fell outside the rectangle.
+     * @param iz  Its strip.
+     * @return    A standard normally distributed number.
+     */
+    double normalTail( int hz, int iz );
+
+    /**
+     * Magnitude of a signed random integer, without overflow at INT_MIN.
+     */
+    static inline unsigned int magnitude( int hz )
+    {
+        return ( hz < 0 ) ? 0u - (unsigned int) hz : (unsigned int) hz;
+    }
+
+public:
+    /**
+     * Constructor.
+     * @param seed    Seed of the run.
+     * @param stream  Stream number (i.e. the particle id).
+     * @param step    Step number within the stream (i.e. the timestep).
+     */
+    Random( uint64 seed, uint64 stream, unsigned int step );
+
+    /**
+     * Random 32 bit integer.
+     * @return  Integer in [0, 2^32-1].
+     */
+    inline unsigned int randInt()
+    {
+        if ( used == 4 )
+            nextBlock();
+
+        return block[used++];
+    }
+
+    /**
+     * Uniformly distributed number with 53 bit resolution.
+     * @return  Real number in [0, 1).
+     */
+    inline double rand53()
+    {
+        const unsigned int a = randInt() >> 5;
+        const unsigned int b = randInt() >> 6;
+        return ( a * 67108864.0 + b ) * (1.0 / 9007199254740992.0);
+    }
+    /**
+     * Normally distributed number.
+     * @param mean   Mean of the distribution.
+     * @param sigma  Standard deviation of the distribution.
+     * @return       The random number.
+     */
+    inline double randNorm( double mean, double sigma )
+    {
+        const int hz = (int) randInt();
+        const int iz = hz & 127;
+
+        // Most of the time the number falls inside a rectangle of the ziggurat.
+        if ( magnitude( hz ) < kn[iz] )
+            return mean + sigma * hz * wn[iz];
+
+        return mean + sigma * normalTail( hz, iz );
+    }
+};
@@ -19,10 +19,14 @@
 #include <stdio.h>
 
 #include "getopt_pp.h"
+#include "MTRand.h"
 
 #include "InOut/InOut.h"
 #include "InOut/ByteInOut.h"
 #include "InOut/TextInOut.h"
+#include "InOut/IndexedInOut.h"
+#include "InOut/CompressedInOut.h"
+#include "InOut/ProfileCache.h"
 
 #include "Emitter/Emitter.h"
 #include "Emitter/GridEmitter.h"
@@ -32,6 +36,8 @@
 #include "Channel/Channel.h"
 
 #include "Particles/Mover.h"
+#include "Particles/EventMover.h"
+#include "Particles/AdaptiveMover.h"
 #include "Particles/ParticleArray.h"
 #include "Particles/Particle.h"
 
@@ -47,6 +53,53 @@ inline void writeProgress( int perc )
     fflush( stdout );
 }
 
+/**
+ * Makes the mover specialized for turbulence model turb and the bounce model.
+ * @param param    Struct of parameters.
+ * @param channel  The channel with continuous phase.
+ * @return         The mover.
+ */
+template <TurbModel turb>
+Mover *newMover( const ScrubberParam &param, Channel *channel )
+{
+    // The event driven mover only exists for the Discrete Eddy Model (checked in parse()).
+    if ( turb == TURB_DISCRETE_EDDY && param.integrator == INTEGRATOR_EVENT )
+    {
+        switch ( param.channel.bounce_model ) {
+            case BOUNCE_STICK:
+                return new EventMover<BOUNCE_STICK>( param, channel );
+            case BOUNCE_SLICOLL:
+                return new EventMover<BOUNCE_SLICOLL>( param, channel );
+            default:
+                cout << "Unknown bounce model";
+                exit( 1 );
+        }
+    }
+
+    if ( param.integrator == INTEGRATOR_ADAPTIVE )
+    {
+        switch ( param.channel.bounce_model ) {
+            case BOUNCE_STICK:
+                return new AdaptiveMover<turb, BOUNCE_STICK>( param, channel );
+            case BOUNCE_SLICOLL:
+                return new AdaptiveMover<turb, BOUNCE_SLICOLL>( param, channel );
+            default:
+                cout << "Unknown bounce model";
+                exit( 1 );
+        }
+    }
+
+    switch ( param.channel.bounce_model ) {
+        case BOUNCE_STICK:
+            return new ModelMover<turb, BOUNCE_STICK>( param, channel );
+        case BOUNCE_SLICOLL:
+            return new ModelMover<turb, BOUNCE_SLICOLL>( param, channel );
+        default:
+            cout << "Unknown bounce model";
+            exit( 1 );
+    }
+}
+
 int main( int argc, char* argv[] )
 {
     // Parameters
@@ -70,6 +123,12 @@ int main( int argc, char* argv[] )
             case INOUT_TEXT:
                 input = new TextInOut( param );
                 break;
+            case INOUT_INDEXED:
+                input = new IndexedInOut( param );
+                break;
+            case INOUT_COMPRESSED:
+                input = new CompressedInOut( param );
+                break;
             default:
                 cout << "Unknown input type.";
                 break;
@@ -90,6 +149,12 @@ int main( int argc, char* argv[] )
         case INOUT_TEXT:
             output = new TextInOut( param );
             break;
+        case INOUT_INDEXED:
+            output = new IndexedInOut( param );
+            break;
+        case INOUT_COMPRESSED:
+            output = new CompressedInOut( param );
+            break;
         default:
             cout << "Unknown output type.";
             break;
@@ -99,7 +164,28 @@ int main( int argc, char* argv[] )
     Channel *channel = new Channel( param );
 
     if ( param.input.format == INOUT_NOIMPORT )
-        channel->init();
+    {
+        // Compute the profile, unless an earlier run with the same channel did. Otherwise
+        // start from the nearest profile in the cache, if any.
+        ProfileCache cache( param );
+        double pg;
+
+        if ( cache.read( &u ) )
+        {
+            printf( "Velocity profile read from %s.\n", cache.getPath().c_str() );
+            channel->init( u );
+        }
+        else
+        {
+            if ( cache.readNearest( &u, &pg ) )
+                channel->init( u, pg );
+            else
+                channel->init();
+
+            if ( cache.write( channel->getVelocityField(), channel->getPressureGradient() ) )
+                printf( "Velocity profile stored in %s.\n", cache.getPath().c_str() );
+        }
+    }
     else
         channel->init( u );
 
@@ -136,16 +222,29 @@ int main( int argc, char* argv[] )
             exit( 1 );
     }
 
-    // Making the particle mover
+    // Making the particle mover, specialized for the turbulence and bounce model
     Mover * mover;
 
-    mover = new Mover( param, channel );
+    switch ( param.channel.turb_model ) {
+        case TURB_NONE:
+            mover = newMover<TURB_NONE>( param, channel );
+            break;
+        case TURB_DISCRETE_EDDY:
+            mover = newMover<TURB_DISCRETE_EDDY>( param, channel );
+            break;
+        case TURB_LANGEVIN:
+            mover = newMover<TURB_LANGEVIN>( param, channel );
+            break;
+        default:
+            cout << "Unknown turbulence model";
+            exit( 1 );
+    }
 
     // Making a struct to keep track of statistics
     StatsStruct stats;
 
-    // Allocating memory for the array that holds the particles
-    ParticleArray particles( param.maxparticles );
+    // Allocating memory for the array that holds the particles (only what the mover uses)
+    ParticleArray particles( param.maxparticles, mover->getColumns() );
 
     // Emit the particles
     emitter->init( &particles );
@@ -182,20 +281,20 @@ int main( int argc, char* argv[] )
 
     printf( "Done after %.5g seconds (%d%%).\n", time, (int) (100 * time / param.duration) );
 
-    int total_out;
-
-    if ( param.channel.bounce_model == BOUNCE_STICK )
-        total_out = stats.p_top + stats.p_bottom + stats.p_wall;
-    else
-        total_out = stats.p_top + stats.p_bottom;
+    // With sliding collisions particles only leave at the wall when the bounce
+    // doesn't bring them back into the box.
+    const int total_out = stats.p_top + stats.p_bottom + stats.p_wall;
 
     printf( "In total %d (* %.5g) particles left the box:\n", total_out, param.p.clustersize );
     printf( "  - Top:    %d (%.5g%%)\n", stats.p_top, 100 * (double) stats.p_top / total_out );
     printf( "  - Bottom: %d (%.5g%%)\n", stats.p_bottom, 100 * (double) stats.p_bottom / total_out );
-    if ( param.channel.bounce_model == BOUNCE_STICK )
+    if ( param.channel.bounce_model == BOUNCE_STICK || stats.p_wall > 0 )
         printf( "  - Wall:   %d (%.5g%%)\n", stats.p_wall, 100 * (double) stats.p_wall / total_out );
-    else
-        printf( "%d times particles bounced off the wall.\n", stats.p_wall );
+    if ( param.channel.bounce_model == BOUNCE_SLICOLL )
+        printf( "%llu times (steps) particles bounced off the wall.\n", stats.bounces );
+
+    if ( param.integrator == INTEGRATOR_ADAPTIVE )
+        printf( "Adaptive sub-steps: %llu accepted, %llu rejected.\n", stats.steps_accepted, stats.steps_rejected );
 
     // In liters:
     const double used_mea = param.p.clustersize * param.p.mole_mea_total * param.mea.mole_mass * total_out / param.mea.density;
@@ -225,11 +324,43 @@ void show_help()
             "  -h, --help                                  Produce this help message.\n"
             "      --duration <double> (=600.0)            Duration of computation in seconds.\n"
             "      --dtscale <double> (=0.5)               dt = dtscale * min( tau_p, tau_m ).\n"
+            "      --dt <double> (=0)                      Timestep size, overrides dtscale if nonzero.\n"
+            "      --integrator <string> (=euler)          Integrator of the particle motion and mass transfer:\n"
+            "                                                euler: explicit Euler, needs dt below tau_a and tau_m.\n"
+            "                                                exp: exact exponential drag and implicit mass transfer,\n"
+            "                                                stable for any dt (limited by the eddy time scales).\n"
+            "                                                event: (mturb 1) jump from eddy to eddy, dt only\n"
+            "                                                synchronizes the particles, it can be up to oint.\n"
+            "                                                adaptive: every particle takes its own sub-steps\n"
+            "                                                within dt, controlled by an error estimate.\n"
+            "      --tol <double> (=0.01)                  Error tolerance of the adaptive integrator, as a\n"
+            "                                                fraction of a grid cell (and of the CO2 capacity).\n"
             "      --errork <double> (=1E-5)               The error threshold for the steady velocity profile.\n"
             "      --relax <double> (=0.9)                 Relaxation for prandtl mixing length. 0 = none, 0.99 = a lot.\n"
+            "      --solver <string> (=auto)               Solver of the velocity profile (auto: thomas with\n"
+            "                                                --globbc 2, unless --anderson or --levels ask for\n"
+            "                                                jacobi; jacobi otherwise):\n"
+            "                                                jacobi: relaxed point iterations (--relax).\n"
+            "                                                thomas: freeze the viscosity and solve the tridiagonal\n"
+            "                                                system directly, then update the viscosity.\n"
+            "                                                newton: Newton-Raphson with the analytic Jacobian\n"
+            "                                                and a line search.\n"
+            "      --anderson <int> (=0)                   History depth of the Anderson acceleration of the\n"
+            "                                                jacobi iterations (0 = off). The iterations then stop\n"
+            "                                                on the defect (as --levels), so they converge the\n"
+            "                                                profile. Mixing length profiles on fine grids need a\n"
+            "                                                depth of about 20; small depths help the constant\n"
+            "                                                viscosity model and coarse grids.\n"
+            "      --levels <int> (=1)                     Number of grids of the jacobi solver (1 = off). More\n"
+            "                                                grids use multigrid V-cycles down to n/2^(levels-1)\n"
+            "                                                volumes (while n stays even), which converge the\n"
+            "                                                profile instead of stopping at the first slow sweep.\n"
             "      --gravangle <double> (=0.0)             Angle of gravity with the negative z-axis.\n"
             "      --maxp <int> (=1000)                    Maximum number of particles, no new particles will be emitted\n"
             "                                                if the number of particles exceeds this parameter.\n"
+            "      --seed <int> (=0)                       Seed of the random number generators (0 = random).\n"
+            "                                                Runs with the same seed give the same results,\n"
+            "                                                independent of the number of threads.\n"
             "\n"
             "Channel Options:\n"
             "      --height <double> (=75.0)               Height of the channel (m).\n"
@@ -237,6 +368,11 @@ void show_help()
             "      --conc_b <double> (=0.05)               Volume fraction of CO2 at the bottom.\n"
             "      --conc_t <double> (=0.01)               Volume fraction of CO2 at the top.\n"
             "      --n <double> (=800)                     Amount of \"volumes\" in the channel.\n"
+            "      --stretch <double> (=0)                 Clustering of the volumes at the walls, to resolve the\n"
+            "                                                viscous layer with fewer volumes (0 = uniform; e.g.\n"
+            "                                                2 gives ~7x, 3 gives ~32x thinner wall volumes). The\n"
+            "                                                bulk velocity is the mean of the volumes on either\n"
+            "                                                grid, without the ghost points in the walls.\n"
             "      --globbc <enum> (=2)                    Global boundary condition:\n"
             "                                                1: Pressure gradient (usually negative).\n"
             "                                                2: Bulk velocity (m/s).\n"
@@ -247,6 +383,10 @@ void show_help()
             "                                                2: Velocity gradient at the wall.\n"
             "      --wallbv <double> (=0.0)                Wall boundary value.\n"
             "                                              ! Meaning dependent on --wallbc. Standard SI-units. !\n"
+            "      --wallfn                                Wall function: the wall shear follows from the log law\n"
+            "                                                at the first node, and the particles between the\n"
+            "                                                walls and the first nodes see the law of the wall.\n"
+            "                                                Allows coarse grids (e.g. --n 50), needs --wallbc 1.\n"
             "      --mbounce <enum> (=1)                   Bounce condition for the particles/wall:\n"
             "                                                1: Stick to the wall.\n"
             "                                                2: Sliding collision:\n"
@@ -284,15 +424,38 @@ void show_help()
             "\n"
             "Input Options:\n"
             "      --profile <string> (=\"\")                Path to profile data (Leave empty to calculate).\n"
+            "      --cache <string> (=\"\")                  Directory of the velocity profile cache (empty = off).\n"
+            "                                                Computed profiles are stored there, and reused by runs\n"
+            "                                                with the same channel, fluid and solver settings.\n"
+            "                                                Otherwise the nearest cached profile of the same model\n"
+            "                                                is the starting point of the solver.\n"
             "Output Options:\n"
             "      --oformat <int> (=1)                    Output formats:\n"
             "                                                1: Byte\n"
             "                                                2: Text\n"
+            "                                                3: Indexed binary, aligned columns per frame\n"
+            "                                                   and an index of the frames (read them with\n"
+            "                                                   TrajectoryReader, make libtrajectory.a).\n"
+            "                                                4: Compressed binary, quantized positions coded as\n"
+            "                                                   differences between the frames (read them\n"
+            "                                                   with CompressedReader, make libtrajectory.a).\n"
             "      --oinfo <int> (=0)                      Output types:\n"
             "                                                0: No writing to file.\n"
             "                                                1: Particle positions.\n"
             "                                                2: Velocity profile of the channel.\n"
             "      --oint <double> (=1.0)                  Write every <double> seconds.\n"
+            "      --oids                                  Write the id of every particle (numbered in order of\n"
+            "                                                emission) after its position and gram_co2, to follow\n"
+            "                                                it from frame to frame. In the byte format the\n"
+            "                                                count of such frames is negative. The indexed and\n"
+            "                                                compressed formats always have the ids.\n"
+            "      --obits <int> (=16)                     Bits per value of the compressed format (1..32): x,\n"
+            "                                                y and gram_co2 are within half of a 2^-bits part of\n"
+            "                                                the channel width, height and range of gram_co2.\n"
+            "      --oqueue <int> (=2)                     Frames that can wait to be written by the output\n"
+            "                                                thread while the simulation continues; when all\n"
+            "                                                are waiting, the simulation waits. 0 writes in\n"
+            "                                                the simulation loop itself.\n"
             "      --out <string> (=test.data)             The path to the output file.\n"
           );
 }
@@ -316,26 +479,38 @@ void parse( int argc, char* argv[], ScrubberParam *param ) {
     // Temporary parse variables
     string s_edim;
     string s_initvel;
+    string s_integrator;
+    string s_solver;
     double gravangle;
+    double dt;
 
     // FIXME: Casts to integer for the enums.
     // Parse the cmdline
     ops >> Option( 'a', "duration",  param->duration, 600.0 )
         >> Option( 'a', "dtscale",   param->dtscale,  0.5 )
+        >> Option( 'a', "dt",        dt,              0.0 )
+        >> Option( 'a', "integrator", s_integrator,   "euler" )
+        >> Option( 'a', "tol",       param->tol,      0.01 )
         >> Option( 'a', "errork",    param->errork,   1E-5 )
         >> Option( 'a', "relax",     param->relax,    0.9 )
+        >> Option( 'a', "solver",    s_solver,        "auto" )
+        >> Option( 'a', "anderson",  param->anderson, 0 )
+        >> Option( 'a', "levels",    param->levels,   1 )
         >> Option( 'a', "gravangle", gravangle,       0.0 )
-        >> Option( 'a', "maxp",      param->maxparticles, 1000 );
+        >> Option( 'a', "maxp",      param->maxparticles, 1000 )
+        >> Option( 'a', "seed",      param->seed,     (uint64) 0 );
         // Channel Options
     ops >> Option( 'a', "height",  param->channel.height,       75.0 )
         >> Option( 'a', "radius",  param->channel.radius,       3.0 )
         >> Option( 'a', "conc_b",  param->channel.conc_b,       0.05 )
         >> Option( 'a', "conc_t",  param->channel.conc_t,       0.01 )
         >> Option( 'a', "n",       param->channel.n,            800 )
+        >> Option( 'a', "stretch", param->channel.stretch,      0.0 )
         >> Option( 'a', "globbc",  param->channel.globbc,       (int) GBC_BULK_VEL )
         >> Option( 'a', "globbv",  param->channel.globbv,       3.0 )
         >> Option( 'a', "wallbc",  param->channel.wallbc,       (int) WBC_VELOCITY )
         >> Option( 'a', "wallbv",  param->channel.wallbv,       0.0 )
+        >> OptionPresent( 'a', "wallfn", param->channel.wall_function )
         >> Option( 'a', "mbounce", param->channel.bounce_model, (int) BOUNCE_STICK )
         >> Option( 'a', "cor",     param->channel.c_restitution, 1.0 )
         >> Option( 'a', "friction", param->channel.c_friction,  0.0 )
@@ -355,19 +530,36 @@ void parse( int argc, char* argv[], ScrubberParam *param ) {
         >> Option( 'a', "rate",    param->emitter.rate, 100.0 )
         >> Option( 'a', "initvel", s_initvel,           "[0,0]" );
         // Input Options
-    ops >> Option( 'a', "profile", param->input.path,   "" );
+    ops >> Option( 'a', "profile", param->input.path,   "" )
+        >> Option( 'a', "cache",   param->cache,        "" );
         // Output Options
     ops >> Option( 'a', "oformat", param->output.format,  (int) INOUT_BYTE )
         >> Option( 'a', "oinfo",   param->output.info,    (int) OUTPUT_NOTHING )
         >> Option( 'a', "oint",    param->output.interval, 1.0 )
+        >> Option( 'a', "oqueue",  param->output.queue,    2 )
+        >> Option( 'a', "obits",   param->output.bits,     16 )
+        >> OptionPresent( 'a', "oids", param->output.ids )
         >> Option( 'a', "out",     param->output.path,     "test.data" );
 
+    // Pick a seed if none was given (printed, so the run can be reproduced).
+    if ( param->seed == 0 )
+    {
+        MTRand seeder;
+        param->seed = ( (uint64) seeder.randInt() << 32 ) | seeder.randInt();
+    }
+
     // Parse and write the temporary variables to the param struct
     param->gravity = 9.81 * Vector2d( sin(gravangle), -cos(gravangle) );
 
     // Extra channel stuff
     param->channel.dx = param->channel.radius*2 / param->channel.n;
 
+    if ( param->channel.stretch < 0 )
+    {
+        printf( "Negative stretch %g, stopping...\n", param->channel.stretch );
+        exit( 1 );
+    }
+
     // Extra fluid stuff
     param->fl.nu = param->fl.mu / param->fl.density;
 
@@ -418,7 +610,72 @@ void parse( int argc, char* argv[], ScrubberParam *param ) {
                    ( 12.0 * param->co2.density * param->co2.diffusivity);
 
     // Check both the particle acceleration time and the mass transfer time for timestep size
-    param->dt = param->dtscale * min( param->tau_p, param->tau_m );
+    if ( dt > 0 )
+        param->dt = dt;
+    else
+        param->dt = param->dtscale * min( param->tau_p, param->tau_m );
+
+    if ( s_integrator == "euler" )
+        param->integrator = INTEGRATOR_EULER;
+    else if ( s_integrator == "exp" )
+        param->integrator = INTEGRATOR_EXP;
+    else if ( s_integrator == "event" )
+        param->integrator = INTEGRATOR_EVENT;
+    else if ( s_integrator == "adaptive" )
+        param->integrator = INTEGRATOR_ADAPTIVE;
+    else
+    {
+        printf( "Unknown integrator %s, stopping...\n", s_integrator.c_str() );
+        exit( 1 );
+    }
+
+    // The pressure gradient search of a bulk velocity needs converged profiles,
+    // which the plain jacobi sweeps do not give.
+    if ( s_solver == "auto" )
+    {
+        const bool jacobi_options = param->anderson > 0 || param->levels > 1;
+        s_solver = ( param->channel.globbc == GBC_BULK_VEL && !jacobi_options ) ? "thomas" : "jacobi";
+    }
+
+    if ( s_solver == "jacobi" )
+        param->channel.solver = SOLVER_JACOBI;
+    else if ( s_solver == "thomas" )
+        param->channel.solver = SOLVER_THOMAS;
+    else if ( s_solver == "newton" )
+        param->channel.solver = SOLVER_NEWTON;
+    else
+    {
+        printf( "Unknown solver %s, stopping...\n", s_solver.c_str() );
+        exit( 1 );
+    }
+
+    if ( param->channel.wall_function && param->channel.wallbc != WBC_VELOCITY )
+    {
+        printf( "The wall function needs a velocity at the wall (--wallbc 1), stopping...\n" );
+        exit( 1 );
+    }
+
+    if ( param->output.queue < 0 )
+    {
+        printf( "The output queue can't be negative, stopping...\n" );
+        exit( 1 );
+    }
+
+    if ( param->output.bits < 1 || param->output.bits > 32 )
+    {
+        printf( "The compressed format needs 1 to 32 bits per value (--obits), stopping...\n" );
+        exit( 1 );
+    }
+
+    if ( param->integrator == INTEGRATOR_EVENT && param->channel.turb_model != TURB_DISCRETE_EDDY )
+    {
+        printf( "The event integrator needs the discrete eddy model (--mturb 1), stopping...\n" );
+        exit( 1 );
+    }
+
+    // Explicit Euler overshoots (and eventually blows up) above the relaxation times.
+    if ( param->integrator == INTEGRATOR_EULER && param->dt > min( param->tau_a, param->tau_m ) )
+        printf( "Warning: dt is larger than tau_a or tau_m, use --integrator exp for such timesteps.\n" );
 
     // Check for possible input
     if ( param->input.path == "" )
@@ -480,5 +737,10 @@ void printParam( const ScrubberParam &param )
     printf( "System Time (tau_a): %.5g\n", param.tau_a );
     printf( "Mass Transfer Time (tau_m): %.5g\n", param.tau_m );
     printf( "Timestep size (dt):  %.5g\n", param.dt );
-    printf( "Amount of timesteps: %.5g\n\n", param.duration / param.dt );
+    const char *integrators[] = { "euler", "exp", "event", "adaptive" };
+    printf( "Integrator:          %s\n", integrators[param.integrator] );
+    if ( param.integrator == INTEGRATOR_ADAPTIVE )
+        printf( "Tolerance:           %.5g\n", param.tol );
+    printf( "Amount of timesteps: %.5g\n", param.duration / param.dt );
+    printf( "Random seed:         %llu\n\n", param.seed );
 }
@@ -50,6 +50,13 @@ enum LoopModel
     LM_VAN_DRIEST
 };
 
+enum ProfileSolver
+{
+    SOLVER_JACOBI,
+    SOLVER_THOMAS,
+    SOLVER_NEWTON
+};
+
 enum TurbModel
 {
     TURB_NONE,
@@ -57,6 +64,14 @@ enum TurbModel
     TURB_LANGEVIN
 };
 
+enum Integrator
+{
+    INTEGRATOR_EULER,
+    INTEGRATOR_EXP,
+    INTEGRATOR_EVENT,
+    INTEGRATOR_ADAPTIVE
+};
+
 enum OutputInfo
 {
     OUTPUT_NOTHING,
@@ -68,7 +83,9 @@ enum InOutFormat
 {
     INOUT_NOIMPORT,
     INOUT_BYTE,
-    INOUT_TEXT
+    INOUT_TEXT,
+    INOUT_INDEXED,
+    INOUT_COMPRESSED
 };
 
 enum EmitterType
@@ -98,6 +115,8 @@ struct ScrubberParam
     double duration;  /// Duration of the computation in seconds.
     double dtscale;   /// The multiplication factor to get from tau_p to dt.
     double dt;        /// Stepsize of the time
+    int integrator;   /// <enum> Integrator of the particle motion and mass transfer.
+    double tol;       /// Error tolerance of the adaptive integrator (fraction of a grid cell).
 
     double tau_p;     /// System time
     double tau_a;     /// System time compensated for density ratio
@@ -105,11 +124,15 @@ struct ScrubberParam
 
     double errork;    /// Maximum error during calculations
     double relax;     /// Relaxation parameter. 0 = no relaxation, 0.99 = a lot.
+    int anderson;     /// History depth of the Anderson acceleration of the profile loops (0 = off).
+    int levels;       /// Number of grids of the coarse to fine profile solve (1 = only n).
 
     Vector2d gravity; /// Gravity vector
 
     int maxparticles; /// Max number of particles that can be emitted.
 
+    uint64 seed;      /// Seed of the random number generators.
+
     // Channel specific parameters
     struct channel
     {
@@ -121,9 +144,11 @@ struct ScrubberParam
 
         int n;                 /// Amount of volumes at one height in the channel.
         double dx;             /// Stepsizes of the grid
+        double stretch;        /// Clustering of the volumes at the walls (0 = uniform).
 
         int wallbc;       /// <enum> Boundary Condition at the wall.
         double wallbv;    /// Value of boundary condition.
+        bool wall_function;  /// Wall shear from the log law at the first node (--wallfn).
         int globbc;       /// <enum> Global boundary condition.
         double globbv;    /// Value of global boundary condition.
 
@@ -132,6 +157,7 @@ struct ScrubberParam
         double c_friction;    /// Friction coefficient
 
         int loop_model;   /// <enum> Model used to get fluid velocity profile in the channel.
+        int solver;       /// <enum> Solver of the velocity profile.
         int turb_model;   /// <enum> Indicates what model to use for generation of eddies/pertubations.
     } channel;
 
@@ -195,12 +221,17 @@ struct ScrubberParam
         string path;  /// Path to profile datafile.
     } input;
 
+    string cache;  /// Directory of the velocity profile cache (empty = off).
+
     // Output specific parameters
     struct output
     {
         int format;       /// <enum> Output type.
         int info;         /// <enum> Information to output (i.e. positions/trajectories/concentration/velocity field)
         double interval;  /// Interval in which to output (every <double> seconds)
+        int queue;        /// Frames that can wait for the writer thread (0 = write synchronously)
+        int bits;         /// Bits per quantized value of the compressed format
+        bool ids;         /// Write the id of every particle in the byte and text formats (--oids)
         string path;      /// Path to datafile
     } output;
 
@@ -215,15 +246,41 @@ struct StatsStruct
         this->p_top = 0;
         this->p_bottom = 0;
         this->p_wall = 0;
+        this->bounces = 0;
 
         this->captured_co2 = 0;
+
+        this->steps_accepted = 0;
+        this->steps_rejected = 0;
+    }
+
+    /**
+     * Adds the statistics of a part of the particles.
+     * @param other  The partial statistics.
+     */
+    void add( const StatsStruct &other )
+    {
+        this->p_top += other.p_top;
+        this->p_bottom += other.p_bottom;
+        this->p_wall += other.p_wall;
+        this->bounces += other.bounces;
+
+        this->captured_co2 += other.captured_co2;
+
+        this->steps_accepted += other.steps_accepted;
+        this->steps_rejected += other.steps_rejected;
     }
 
     int p_top;     /// Amount of particles that left at the top
     int p_bottom;  /// Amount of particles that left at the bottom
-    int p_wall;    /// Amount of times the particles hit the wall / Amount of particles that left at the wall
+    int p_wall;    /// Amount of particles that left at the wall
+
+    uint64 bounces;  /// Amount of steps in which a particle bounced off the wall (sliding collisions)
 
     double captured_co2;  /// Amount of gram CO2 captured
+
+    uint64 steps_accepted;  /// Sub-steps of the adaptive mover that were accepted
+    uint64 steps_rejected;  /// Sub-steps of the adaptive mover that were rejected
 };
 
 
@@ -27,6 +27,7 @@ typedef blitz::TinyVector<double, 2> Vector2d;
 typedef blitz::Array<double, 1> ScalarField;
 typedef blitz::TinyVector<int, 2> TGrid;
 typedef blitz::TinyMatrix<double, 2, 2> TDelimiter;
+typedef unsigned long long uint64;
 
 double inline pow2( const double &c )
 {
@@ -41,3 +42,7 @@ double inline pow3( const double &c )
 template <class T> const T& min ( const T& a, const T& b ) {
   return (a<b)?a:b;
 }
+
+template <class T> const T& max ( const T& a, const T& b ) {
+  return (a>b)?a:b;
+}